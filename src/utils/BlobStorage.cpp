@@ -0,0 +1,202 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#include "BlobStorage.hpp"
+
+#include <cstring>
+#include <vector>
+
+#include <hardware/sync.h>
+#include <pico/multicore.h>
+
+#include <utils/Defer.hpp>
+
+BlobStorage::BlobStorage(details::NVStorage &storage)
+    : d_storage{storage} {}
+
+BlobStorage &BlobStorage::Default() {
+	static BlobStorage storage(details::NVStorage::Default());
+	return storage;
+}
+
+// FNV-1a
+uint32_t BlobStorage::hash(const char *key, size_t length) {
+	uint32_t res = 2166136261;
+	for (size_t i = 0; i < length; ++i) {
+		res = (res ^ uint8_t(key[i])) * 16777619;
+	}
+	return res;
+}
+
+void BlobStorage::mount() {
+	if (d_mounted) {
+		return;
+	}
+	// mounting the region may finish an interrupted compaction.
+	multicore_lockout_start_blocking();
+	defer {
+		multicore_lockout_end_blocking();
+	};
+	// the other core may have mounted it while this one waited.
+	if (d_mounted) {
+		return;
+	}
+	d_mounted = true;
+
+	std::vector<uint16_t> uuids;
+	d_storage.ForEach([&uuids](uint16_t uuid, size_t) {
+		if (uuid >= FIRST_UUID && uuid < FIRST_UUID + 2 * MAX_KEYS) {
+			uuids.push_back(uuid);
+		}
+	});
+	for (auto uuid : uuids) {
+		// Left by a deletion interrupted between the value and the key.
+		if (d_storage.SizeOf(uuid ^ 1).has_value() == false) {
+			d_storage.Delete(uuid);
+			continue;
+		}
+		if (uuid % 2 != 0) {
+			continue;
+		}
+		char key[MAX_KEY_SIZE];
+		auto length = d_storage.Read(uuid, key, MAX_KEY_SIZE).value();
+		d_keys.insert({hash(key, std::min(length, MAX_KEY_SIZE)), uuid});
+	}
+	debugf("[BlobStorage]: mounted %d key(s)\n", d_keys.size());
+}
+
+std::optional<uint16_t> BlobStorage::find(const char *key, size_t length) {
+	auto [begin, end] = d_keys.equal_range(hash(key, length));
+	for (auto it = begin; it != end; ++it) {
+		char stored[MAX_KEY_SIZE];
+		if (d_storage.Read(it->second, stored, MAX_KEY_SIZE) == length &&
+		    memcmp(stored, key, length) == 0) {
+			return it->second;
+		}
+	}
+	return std::nullopt;
+}
+
+std::optional<uint16_t> BlobStorage::unusedIdentifier(uint32_t hash) {
+	// starting from the hash spreads the keys over the identifiers.
+	for (size_t i = 0; i < MAX_KEYS; ++i) {
+		uint16_t uuid = FIRST_UUID + 2 * ((hash + i) % MAX_KEYS);
+		if (d_storage.SizeOf(uuid).has_value() == false &&
+		    d_storage.SizeOf(uuid + 1).has_value() == false) {
+			return uuid;
+		}
+	}
+	return std::nullopt;
+}
+
+std::optional<size_t>
+BlobStorage::Get(const char *key, void *data, size_t size) {
+	size_t length = strnlen(key, MAX_KEY_SIZE + 1);
+	if (length > MAX_KEY_SIZE) {
+		return std::nullopt;
+	}
+	mount();
+	// not locked out by the other core halfway through the read.
+	auto saved = save_and_disable_interrupts();
+	defer {
+		restore_interrupts(saved);
+	};
+	auto uuid = find(key, length);
+	if (uuid.has_value() == false) {
+		return std::nullopt;
+	}
+	return d_storage.Read(uuid.value() + 1, data, size);
+}
+
+bool BlobStorage::Put(const char *key, const void *data, size_t size) {
+	size_t length = strnlen(key, MAX_KEY_SIZE + 1);
+	if (length > MAX_KEY_SIZE || size > MAX_VALUE_SIZE) {
+		return false;
+	}
+	mount();
+	multicore_lockout_start_blocking();
+	defer {
+		multicore_lockout_end_blocking();
+	};
+
+	auto h    = hash(key, length);
+	auto uuid = find(key, length);
+	bool isNew = uuid.has_value() == false;
+	if (isNew) {
+		uuid = unusedIdentifier(h);
+		if (uuid.has_value() == false) {
+			return false;
+		}
+	}
+	// only the value is saved when the key is already stored.
+	details::NVStorage::Entry entries[] = {
+	    {.UUID = uuid.value(), .Object = key, .Size = length},
+	    {.UUID = uint16_t(uuid.value() + 1), .Object = data, .Size = size},
+	};
+	if (d_storage.SaveAll(entries, 2) == details::NVStorage::Progress::FAILED) {
+		return false;
+	}
+	if (isNew) {
+		d_keys.insert({h, uuid.value()});
+	}
+	return true;
+}
+
+bool BlobStorage::Delete(const char *key) {
+	size_t length = strnlen(key, MAX_KEY_SIZE + 1);
+	if (length > MAX_KEY_SIZE) {
+		return false;
+	}
+	mount();
+	multicore_lockout_start_blocking();
+	defer {
+		multicore_lockout_end_blocking();
+	};
+
+	auto uuid = find(key, length);
+	if (uuid.has_value() == false) {
+		return false;
+	}
+	// the value first, a key left alone is deleted by the next mount.
+	if (d_storage.Delete(uuid.value() + 1) == false ||
+	    d_storage.Delete(uuid.value()) == false) {
+		return false;
+	}
+	auto [begin, end] = d_keys.equal_range(hash(key, length));
+	for (auto it = begin; it != end; ++it) {
+		if (it->second == uuid.value()) {
+			d_keys.erase(it);
+			break;
+		}
+	}
+	return true;
+}
+
+void BlobStorage::ForEach(
+    const std::function<void(const char *key, size_t size)> &fn
+) {
+	mount();
+	std::vector<uint16_t> uuids;
+	for (const auto &[h, uuid] : d_keys) {
+		uuids.push_back(uuid);
+	}
+	// fn may modify the storage, so each key is read on its own.
+	for (auto uuid : uuids) {
+		char                  key[MAX_KEY_SIZE + 1];
+		std::optional<size_t> length, size;
+		{
+			auto saved = save_and_disable_interrupts();
+			length     = d_storage.Read(uuid, key, MAX_KEY_SIZE);
+			size       = d_storage.SizeOf(uuid + 1);
+			restore_interrupts(saved);
+		}
+		if (length.has_value() && size.has_value()) {
+			key[std::min(length.value(), MAX_KEY_SIZE)] = 0;
+			fn(key, size.value());
+		}
+	}
+}
+
+size_t BlobStorage::Size() {
+	mount();
+	return d_keys.size();
+}
@@ -0,0 +1,78 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+
+#include <utils/FlashStorage.hpp>
+
+// Longest BlobStorage key, its terminating zero excluded.
+#ifndef PICO_BLOB_STORAGE_MAX_KEY_SIZE
+#define PICO_BLOB_STORAGE_MAX_KEY_SIZE 31
+#endif
+
+// Values of any size stored under keys chosen at runtime, e.g. network
+// credentials, per-channel calibrations or device names, in the region shared
+// with FlashStorage.
+//
+// Each key takes a pair of identifiers from NVStorage::FIRST_RESERVED_UUID:
+// one for the record holding the key, the next one for its value. A new key
+// is saved together with its value in a transaction, so a power loss never
+// leaves one without the other. The keys are hashed in RAM the first time the
+// storage is used, a lookup only reads the records with the same hash.
+//
+// Like FlashStorage, modifications lock the other core out.
+class BlobStorage {
+public:
+	static constexpr size_t MAX_KEY_SIZE = PICO_BLOB_STORAGE_MAX_KEY_SIZE;
+
+	// a new key, its value and their commit must fit in a sector.
+	static constexpr size_t MAX_VALUE_SIZE =
+	    (details::NVStorage::SLOTS_PER_SECTOR -
+	     details::NVStorage::FIRST_SLOT -
+	     details::NVStorage::SlotsFor(MAX_KEY_SIZE) -
+	     details::NVStorage::SlotsFor(sizeof(uint32_t))) *
+	        details::NVStorage::SLOT_SIZE -
+	    sizeof(details::NVStorage::Header);
+
+	BlobStorage(details::NVStorage &storage);
+
+	// Over details::NVStorage::Default(), the board flash.
+	static BlobStorage &Default();
+
+	// Copies at most size bytes of the value, returns its size or nullopt
+	// when the key is not stored.
+	std::optional<size_t> Get(const char *key, void *data, size_t size);
+
+	bool Put(const char *key, const void *data, size_t size);
+
+	// Returns false when the key is not stored.
+	bool Delete(const char *key);
+
+	// Calls fn with every key and the size of its value.
+	void ForEach(const std::function<void(const char *key, size_t size)> &fn);
+
+	size_t Size();
+
+private:
+	static constexpr uint16_t FIRST_UUID =
+	    details::NVStorage::FIRST_RESERVED_UUID;
+	static constexpr size_t MAX_KEYS =
+	    (details::NVStorage::DELETE_UUID - FIRST_UUID) / 2;
+
+	static uint32_t hash(const char *key, size_t length);
+
+	void mount();
+
+	std::optional<uint16_t> find(const char *key, size_t length);
+	std::optional<uint16_t> unusedIdentifier(uint32_t hash);
+
+	details::NVStorage &d_storage;
+	bool                d_mounted = false;
+	// identifiers of the key records, by hash of their key.
+	std::unordered_multimap<uint32_t, uint16_t> d_keys;
+};
@@ -2,21 +2,80 @@
 
 #include "Button.hpp"
 
+#include <algorithm>
 #include <optional>
 
 #include <hardware/gpio.h>
+#include <hardware/irq.h>
+#include <pico/platform/panic.h>
 #include <pico/time.h>
 #include <pico/types.h>
 
 #include <utils/Log.hpp>
 #include <utils/Scheduler.hpp>
 
-Button::Button(uint pin)
-    : d_pin{pin} {
+Button *Button::s_buttons[PICO_BUTTON_MAX_INTERRUPTS] = {};
+bool    Button::s_handlerInstalled                    = false;
+
+Button::Button(uint pin, Mode mode, const GestureConfig &config)
+    : details::GestureMachine{States, config}
+    , d_pin{pin}
+    , d_mode{mode} {
+	if (d_mode == Mode::EXTERNAL) {
+		return;
+	}
 
 	gpio_init(d_pin);
 	gpio_set_dir(d_pin, false);
 	gpio_pull_up(d_pin);
+
+	if (d_mode == Mode::POLLED) {
+		return;
+	}
+
+	bool registered = false;
+	for (auto &b : s_buttons) {
+		if (b == nullptr) {
+			b          = this;
+			registered = true;
+			break;
+		}
+	}
+	if (registered == false) {
+		panic("[Button]: more than PICO_BUTTON_MAX_INTERRUPTS buttons");
+	}
+	// the handler stays installed once the buttons are gone, with nothing
+	// to do.
+	if (s_handlerInstalled == false) {
+		s_handlerInstalled = true;
+		irq_add_shared_handler(
+		    IO_IRQ_BANK0,
+		    onEdges,
+		    PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY
+		);
+		irq_set_enabled(IO_IRQ_BANK0, true);
+	}
+	gpio_set_irq_enabled(
+	    d_pin,
+	    GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE,
+	    true
+	);
+}
+
+Button::~Button() {
+	if (d_mode != Mode::INTERRUPTS) {
+		return;
+	}
+	gpio_set_irq_enabled(
+	    d_pin,
+	    GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE,
+	    false
+	);
+	for (auto &b : s_buttons) {
+		if (b == this) {
+			b = nullptr;
+		}
+	}
 }
 
 std::optional<Button::Event> Button::Pending() {
@@ -28,70 +87,143 @@ std::optional<Button::Event> Button::Pending() {
 	return e;
 }
 
-void Button::pushEvent(Event e) {
-	d_pendingEvents.insert(e);
+void Button::SetCallback(Callback &&callback) {
+	d_callback = std::move(callback);
 }
 
-void Button::Update(absolute_time_t now) {
-	static constexpr uint64_t MULTIPLE_CLICK_MAX_PERIOD_us = 300 * 1000;
-	static constexpr uint64_t LONG_PRESS_MIN_TIME_us       = 250 * 1000;
-	static constexpr uint64_t DEBOUNCE_TIME_us             = 20 * 1000;
-
+std::optional<Button::Event> Button::EventOf(const GestureEvent &e) {
 	static Event multipleClickEvent[3] = {
 	    Event::CLICK,
 	    Event::DOUBLE_CLICK,
 	    Event::TRIPLE_CLICK,
 	};
 
-	switch (d_state) {
-	case State::IDLE:
-		if (d_clicks > 0 && absolute_time_diff_us(d_transition, now) >
-		                        MULTIPLE_CLICK_MAX_PERIOD_us) {
-			pushEvent(multipleClickEvent[d_clicks - 1]);
-			d_clicks = 0;
-		}
+	switch (e.Type) {
+	case Gesture::CLICKS:
+		return multipleClickEvent[std::min(3U, uint(e.Count)) - 1];
+	case Gesture::PRESS_DOWN:
+		return Event::PRESS_DOWN;
+	case Gesture::RELEASE:
+		return Event::RELEASE;
+	default:
+		return std::nullopt;
+	}
+}
+
+void Button::onGesture(const GestureEvent &e) {
+	GestureEvent event = e;
+	event.Button       = d_pin;
+	event.Buttons      = 1U << d_pin;
+
+	auto pending = EventOf(event);
+	if (pending.has_value()) {
+		d_pendingEvents.insert(pending.value());
+	}
+	if (d_callback != nullptr) {
+		d_callback(event);
+	}
+}
 
-		if (gpio_get(d_pin) == false) {
-			d_transition = now;
-			d_state      = State::DEBOUNCE;
+void Button::Update(absolute_time_t now) {
+	advance(gpio_get(d_pin), now);
+}
+
+void Button::Process(bool pressed, absolute_time_t now) {
+	advance(pressed == false, now);
+}
+
+void Button::onEdges() {
+	constexpr uint32_t EDGES = GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE;
+
+	auto now = get_absolute_time();
+	for (auto b : s_buttons) {
+		if (b == nullptr) {
+			continue;
 		}
-		break;
-	case State::DEBOUNCE:
-		if (gpio_get(d_pin) == true) {
-			d_transition = now;
-			d_state      = State::IDLE;
-			break;
+		uint32_t events = gpio_get_irq_event_mask(b->d_pin) & EDGES;
+		if (events == 0) {
+			continue;
 		}
+		gpio_acknowledge_irq(b->d_pin, events);
+		Edge edge = {.Time = now, .Released = gpio_get(b->d_pin)};
+		if (b->d_edges.write(&edge, sizeof(Edge)) == false) {
+			b->d_overflow.store(true, std::memory_order_release);
+		}
+	}
+}
 
-		if (absolute_time_diff_us(d_transition, now) > DEBOUNCE_TIME_us) {
-			d_state      = State::PRESSED;
-			d_transition = now;
+void Button::ScheduleUpdateTask() {
+	Scheduler::Get().Schedule(
+	    PICO_BUTTON_IDLE_PERIOD_US,
+	    updateAllTask,
+	    {.Start = 0, .Name = "buttons"}
+	);
+}
+
+std::optional<int64_t> Button::updateAllTask(absolute_time_t now) {
+	std::optional<absolute_time_t> next;
+	for (auto b : s_buttons) {
+		if (b == nullptr) {
+			continue;
 		}
-		break;
-	case State::PRESSED:
-		if (gpio_get(d_pin) == true) {
-			d_clicks     = std::min(3U, d_clicks + 1);
-			d_transition = now;
-			d_state      = State::IDLE;
-			break;
+		for (Edge edge; b->d_edges.read(&edge, sizeof(Edge));) {
+			b->advance(edge.Released, edge.Time);
 		}
-
-		if (absolute_time_diff_us(d_transition, now) > LONG_PRESS_MIN_TIME_us) {
-			if (d_clicks > 0) {
-				pushEvent(multipleClickEvent[d_clicks]);
-				d_clicks = 0;
-			}
-			pushEvent(Event::PRESS_DOWN);
-			d_transition = now;
-			d_state      = State::LONG_PRESSED;
+		if (b->d_overflow.exchange(false, std::memory_order_acquire)) {
+			// some edges are lost, the level is sampled again.
+			b->advance(gpio_get(b->d_pin), now);
+		} else {
+			b->advance(b->d_released, now);
 		}
-		break;
-	case State::LONG_PRESSED:
-		if (gpio_get(d_pin) == true) {
-			pushEvent(Event::RELEASE);
-			d_transition = now;
-			d_state      = State::IDLE;
+
+		auto d = b->deadline();
+		if (d.has_value() && (next.has_value() == false || d < next)) {
+			next = d;
 		}
-		break;
 	}
+	if (next.has_value() == false) {
+		return PICO_BUTTON_IDLE_PERIOD_US;
+	}
+	// runs again when the first timeout expires.
+	return std::clamp<int64_t>(
+	    absolute_time_diff_us(now, next.value()),
+	    1,
+	    PICO_BUTTON_IDLE_PERIOD_US
+	);
+}
+
+std::optional<absolute_time_t> Button::deadline() const {
+	absolute_time_t res = NextDeadline();
+	if (d_debouncing) {
+		res = std::min(res, d_pressStart + DEBOUNCE_TIME_us + 1);
+	}
+	if (res == at_the_end_of_time) {
+		return std::nullopt;
+	}
+	return res;
+}
+
+// Presses are debounced here, and given to the machine once they last
+// strictly more than DEBOUNCE_TIME_us. Timeouts expired before now happen at
+// the time they expire, so the events do not depend on how late the edges
+// are processed.
+void Button::advance(bool released, absolute_time_t now) {
+	absolute_time_t debounced = d_pressStart + DEBOUNCE_TIME_us + 1;
+	if (d_debouncing && debounced <= now) {
+		d_debouncing = false;
+		d_pressed    = true;
+		Step(1, 1, debounced);
+	}
+
+	uint32_t changed = 0;
+	if (released) {
+		changed      = d_pressed;
+		d_pressed    = false;
+		d_debouncing = false;
+	} else if (d_pressed == false && d_debouncing == false) {
+		d_debouncing = true;
+		d_pressStart = now;
+	}
+	d_released = released;
+	Step(changed, d_pressed, now);
 }
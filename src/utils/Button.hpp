@@ -2,12 +2,28 @@
 
 #pragma once
 
+#include "utils/ByteRing.hpp"
+#include "utils/Gestures.hpp"
 #include "utils/Queue.hpp"
 #include "utils/RingBuffer.hpp"
 #include "utils/Scheduler.hpp"
+#include <functional>
 #include <pico/types.h>
 
-class Button {
+// Maximal number of buttons in Mode::INTERRUPTS.
+#ifndef PICO_BUTTON_MAX_INTERRUPTS
+#define PICO_BUTTON_MAX_INTERRUPTS 8
+#endif
+
+// Period of the update task when no edge or timeout is pending.
+#ifndef PICO_BUTTON_IDLE_PERIOD_US
+#define PICO_BUTTON_IDLE_PERIOD_US 20000
+#endif
+
+// A button on a GPIO, debounced in time and given to a GestureMachine as a
+// single button.
+class Button : private details::GestureStates<1>,
+               private details::GestureMachine {
 public:
 	enum class Event {
 		CLICK,
@@ -17,25 +33,91 @@ public:
 		RELEASE,
 	};
 
-	Button(uint pin);
+	typedef std::function<void(const GestureEvent &)> Callback;
+
+	// clicks, press downs and releases only.
+	static constexpr GestureConfig DEFAULT_CONFIG = {
+	    .RepeatDelay_us = 0,
+	    .Holds_ms       = {},
+	};
+
+	static constexpr uint64_t MULTIPLE_CLICK_MAX_PERIOD_us =
+	    DEFAULT_CONFIG.MultipleClickMaxPeriod_us;
+	static constexpr uint64_t LONG_PRESS_MIN_TIME_us =
+	    DEFAULT_CONFIG.LongPress_us;
+	static constexpr uint64_t DEBOUNCE_TIME_us = 20 * 1000;
+
+	enum class Mode {
+		// Update() samples the pin.
+		POLLED,
+		// The edges of the pin are timestamped by an interrupt, and processed
+		// by the update task.
+		INTERRUPTS,
+		// The pin is not touched, its samples are given to Process().
+		EXTERNAL,
+	};
+
+	Button(
+	    uint                 pin,
+	    Mode                 mode   = Mode::POLLED,
+	    const GestureConfig &config = DEFAULT_CONFIG
+	);
+	~Button();
+
+	Button(const Button &)            = delete;
+	Button(Button &&)                 = delete;
+	Button &operator=(const Button &) = delete;
+	Button &operator=(Button &&)      = delete;
 
 	std::optional<Event> Pending();
 
+	// Calls callback with all the gestures of the configuration, from
+	// Update(), Process() or the update task.
+	void SetCallback(Callback &&callback);
+
+	// The Event of a gesture, if it has one.
+	static std::optional<Event> EventOf(const GestureEvent &e);
+
 	void Update(absolute_time_t now);
 
+	// Processes a sample of the button read by other means.
+	void Process(bool pressed, absolute_time_t now);
+
+	// Processes the edges of the buttons in Mode::INTERRUPTS. It only runs
+	// at PICO_BUTTON_IDLE_PERIOD_US while they are idle.
+	static void ScheduleUpdateTask();
+
 private:
-	enum class State {
-		IDLE,
-		DEBOUNCE,
-		PRESSED,
-		LONG_PRESSED,
+	struct Edge {
+		absolute_time_t Time;
+		bool            Released;
 	};
 
-	void pushEvent(Event e);
+	void onGesture(const GestureEvent &e) override;
+
+	void advance(bool released, absolute_time_t now);
+
+	std::optional<absolute_time_t> deadline() const;
+
+	static void onEdges();
+
+	static std::optional<int64_t> updateAllTask(absolute_time_t now);
+
+	static Button *s_buttons[PICO_BUTTON_MAX_INTERRUPTS];
+	static bool    s_handlerInstalled;
 
 	uint                 d_pin;
+	Mode                 d_mode;
 	RingBuffer<Event, 8> d_pendingEvents;
-	State                d_state      = State::IDLE;
-	uint                 d_clicks     = 0;
-	absolute_time_t      d_transition = 0;
+	Callback             d_callback;
+	// debounced level, and the start of the press being debounced.
+	bool            d_pressed    = false;
+	bool            d_debouncing = false;
+	absolute_time_t d_pressStart = 0;
+	// level last processed.
+	bool d_released = true;
+
+	// filled by the interrupt handler.
+	ByteRing<8 * sizeof(Edge)> d_edges;
+	std::atomic<bool>          d_overflow{false};
 };
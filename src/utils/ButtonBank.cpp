@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "ButtonBank.hpp"
+
+#include <hardware/gpio.h>
+
+namespace details {
+DebouncedButtons::DebouncedButtons(
+    uint32_t buttons, Input input, const GestureConfig &config
+)
+    : GestureMachine{States, config}
+    , d_buttons{buttons}
+    , d_input{input} {
+	if (input == Input::EXTERNAL) {
+		return;
+	}
+	gpio_init_mask(d_buttons);
+	for (uint32_t m = d_buttons; m != 0; m &= m - 1) {
+		gpio_pull_up(__builtin_ctz(m));
+	}
+}
+
+void DebouncedButtons::Process(uint32_t pressed, absolute_time_t now) {
+	uint32_t changed = d_debouncer.Sample(pressed & d_buttons);
+	Step(changed, d_debouncer.Levels(), now);
+}
+} // namespace details
+
+ButtonBank::ButtonBank(uint32_t pins, Input input, const GestureConfig &config)
+    : details::DebouncedButtons{pins, input, config} {}
+
+std::optional<ButtonBank::PinEvent> ButtonBank::Pending() {
+	if (d_pendingEvents.empty()) {
+		return std::nullopt;
+	}
+	PinEvent e;
+	d_pendingEvents.pop(e);
+	return e;
+}
+
+void ButtonBank::Update(absolute_time_t now) {
+	Process(~gpio_get_all(), now);
+}
+
+void ButtonBank::onGesture(const GestureEvent &e) {
+	auto event = Button::EventOf(e);
+	if (event.has_value()) {
+		PinEvent pending = {.Pin = e.Button, .Event = event.value()};
+		d_pendingEvents.insert(pending);
+	}
+}
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: LGPL-3.0+
+
+#pragma once
+
+#include "utils/Button.hpp"
+#include "utils/Gestures.hpp"
+#include "utils/RingBuffer.hpp"
+#include <optional>
+#include <pico/types.h>
+
+namespace details {
+// Debounces 32 inputs in parallel with 2-bit vertical counters: bit i of
+// d_count0 and d_count1 count the consecutive samples of input i differing
+// from its debounced level. It toggles after SAMPLES of them, and any sample
+// equal to it resets its counter.
+class VerticalDebouncer {
+public:
+	static constexpr int SAMPLES = 4;
+
+	// Returns the inputs that toggled.
+	uint32_t Sample(uint32_t levels) {
+		uint32_t changed = levels ^ d_levels;
+		d_count0         = ~(d_count0 & changed);
+		d_count1         = d_count0 ^ (d_count1 & changed);
+		changed &= d_count0 & d_count1;
+		d_levels ^= changed;
+		return changed;
+	}
+
+	uint32_t Levels() const {
+		return d_levels;
+	}
+
+private:
+	uint32_t d_levels = 0;
+	uint32_t d_count0 = ~0U;
+	uint32_t d_count1 = ~0U;
+};
+
+// Buttons sampled together and debounced in parallel, whose gestures are
+// recognized by a GestureMachine. ButtonBank and ButtonGestures only differ
+// in how they deliver them, from onGesture().
+class DebouncedButtons : private GestureStates<32>, protected GestureMachine {
+public:
+	enum class Input {
+		// buttons on the GPIOs, active low with a pull-up, sampled by
+		// Update() or the update task.
+		GPIOS,
+		// keys only sampled through Process(), like the ones of a KeyMatrix.
+		EXTERNAL,
+	};
+
+	// Processes a sample of the buttons, a bit set for each pressed one,
+	// every ButtonBank::SAMPLE_PERIOD_us.
+	void Process(uint32_t pressed, absolute_time_t now);
+
+	// Debounced level of the buttons, a bit set for each pressed one.
+	uint32_t Pressed() const {
+		return d_debouncer.Levels();
+	}
+
+protected:
+	// Buttons set in the mask, the pins for Input::GPIOS.
+	DebouncedButtons(
+	    uint32_t buttons, Input input, const GestureConfig &config
+	);
+
+	uint32_t d_buttons;
+	Input    d_input;
+
+private:
+	VerticalDebouncer d_debouncer;
+};
+} // namespace details
+
+// Buttons on any of the GPIOs, sampled together with a single gpio_get_all()
+// and debounced in parallel. They generate the same events as Button.
+class ButtonBank : public details::DebouncedButtons {
+public:
+	// Update() debounces over that many samples, and must be called at this
+	// period so the debounce time matches Button::DEBOUNCE_TIME_us.
+	static constexpr int      DEBOUNCE_SAMPLES =
+	    details::VerticalDebouncer::SAMPLES;
+	static constexpr uint64_t SAMPLE_PERIOD_us =
+	    Button::DEBOUNCE_TIME_us / DEBOUNCE_SAMPLES;
+	static_assert(
+	    PICO_GESTURE_MIN_REPEAT_PERIOD_US >= SAMPLE_PERIOD_us,
+	    "repeats could pile up between samples"
+	);
+
+	struct PinEvent {
+		uint          Pin;
+		Button::Event Event;
+	};
+
+	// The clicks, press downs and releases of the configuration are reported
+	// like Button does.
+	ButtonBank(
+	    uint32_t             pins,
+	    Input                input  = Input::GPIOS,
+	    const GestureConfig &config = Button::DEFAULT_CONFIG
+	);
+
+	std::optional<PinEvent> Pending();
+
+	void Update(absolute_time_t now);
+
+private:
+	void onGesture(const GestureEvent &e) override;
+
+	RingBuffer<PinEvent, 16> d_pendingEvents;
+};
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "ButtonGestures.hpp"
+
+#include <algorithm>
+
+#include <hardware/gpio.h>
+#include <pico/platform/panic.h>
+
+#include <utils/Scheduler.hpp>
+
+std::vector<ButtonGestures *> &ButtonGestures::engines() {
+	static std::vector<ButtonGestures *> s_engines;
+	return s_engines;
+}
+
+ButtonGestures::ButtonGestures(
+    uint32_t buttons, Input input, const GestureConfig &config
+)
+    : details::DebouncedButtons{buttons, input, config} {
+	engines().push_back(this);
+}
+
+ButtonGestures::~ButtonGestures() {
+	auto &e = engines();
+	e.erase(std::remove(e.begin(), e.end(), this), e.end());
+}
+
+void ButtonGestures::Subscribe(uint32_t buttons, Callback &&callback) {
+	for (auto &s : d_subscribers) {
+		if (s.Function == nullptr) {
+			s = {.Buttons = buttons, .Function = std::move(callback)};
+			return;
+		}
+	}
+	panic("[ButtonGestures]: more than PICO_GESTURE_MAX_SUBSCRIBERS");
+}
+
+void ButtonGestures::ScheduleUpdateTask() {
+	Scheduler::Get().Schedule(
+	    ButtonBank::SAMPLE_PERIOD_us,
+	    updateAllTask,
+	    {.Start = 0, .Name = "gestures"}
+	);
+}
+
+std::optional<int64_t> ButtonGestures::updateAllTask(absolute_time_t now) {
+	for (const auto self : engines()) {
+		if (self->d_input == Input::GPIOS) {
+			self->Process(~gpio_get_all(), now);
+		}
+		self->Dispatch();
+	}
+	return std::nullopt;
+}
+
+void ButtonGestures::Dispatch() {
+	for (GestureEvent e; d_events.pop(e);) {
+		for (const auto &s : d_subscribers) {
+			if (s.Function != nullptr && (s.Buttons & e.Buttons) != 0) {
+				s.Function(e);
+			}
+		}
+	}
+}
+
+void ButtonGestures::onGesture(const GestureEvent &e) {
+	d_events.insert(e);
+}
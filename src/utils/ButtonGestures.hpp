@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: LGPL-3.0+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include <pico/types.h>
+
+#include <utils/ButtonBank.hpp>
+#include <utils/Gestures.hpp>
+#include <utils/RingBuffer.hpp>
+
+// Maximal number of subscribers of an engine.
+#ifndef PICO_GESTURE_MAX_SUBSCRIBERS
+#define PICO_GESTURE_MAX_SUBSCRIBERS 4
+#endif
+
+// Recognizes gestures on buttons debounced together like a ButtonBank. The
+// gestures are delivered to the subscribers by the update task.
+class ButtonGestures : public details::DebouncedButtons {
+public:
+	typedef std::function<void(const GestureEvent &)> Callback;
+
+	ButtonGestures(
+	    uint32_t             buttons,
+	    Input                input  = Input::GPIOS,
+	    const GestureConfig &config = {}
+	);
+	~ButtonGestures();
+
+	ButtonGestures(const ButtonGestures &)            = delete;
+	ButtonGestures(ButtonGestures &&)                 = delete;
+	ButtonGestures &operator=(const ButtonGestures &) = delete;
+	ButtonGestures &operator=(ButtonGestures &&)      = delete;
+
+	// Calls callback with the gestures involving any of the buttons.
+	void Subscribe(uint32_t buttons, Callback &&callback);
+
+	using details::GestureMachine::AddChord;
+
+	// Calls the subscribers with the pending gestures, done by the update
+	// task.
+	void Dispatch();
+
+	static void ScheduleUpdateTask();
+
+private:
+	struct Subscriber {
+		uint32_t Buttons;
+		Callback Function;
+	};
+
+	void onGesture(const GestureEvent &e) override;
+
+	static std::optional<int64_t> updateAllTask(absolute_time_t now);
+
+	static std::vector<ButtonGestures *> &engines();
+
+	std::array<Subscriber, PICO_GESTURE_MAX_SUBSCRIBERS> d_subscribers{};
+	RingBuffer<GestureEvent, 16>                         d_events;
+};
@@ -0,0 +1,122 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+// Lock-free single producer / single consumer ring of bytes. The producer
+// only moves d_head and the consumer only moves d_tail, so one side may run
+// on each core without any lock. N must be a power of two.
+template <size_t N> class ByteRing {
+public:
+	static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+
+	inline size_t size() const {
+		return d_head.load(std::memory_order_acquire) -
+		       d_tail.load(std::memory_order_acquire);
+	}
+
+	inline size_t free() const {
+		return N - size();
+	}
+
+	inline bool empty() const {
+		return size() == 0;
+	}
+
+	// Writes all of data or nothing.
+	inline bool write(const void *data, size_t size) {
+		auto head = d_head.load(std::memory_order_relaxed);
+		if (N - (head - d_tail.load(std::memory_order_acquire)) < size) {
+			return false;
+		}
+		copyIn(head, data, size);
+		d_head.store(head + size, std::memory_order_release);
+		return true;
+	}
+
+	// Writes several buffers as a single all or nothing operation.
+	inline bool write(
+	    const void *first,
+	    size_t      firstSize,
+	    const void *second,
+	    size_t      secondSize
+	) {
+		auto head = d_head.load(std::memory_order_relaxed);
+		if (N - (head - d_tail.load(std::memory_order_acquire)) <
+		    firstSize + secondSize) {
+			return false;
+		}
+		copyIn(head, first, firstSize);
+		copyIn(head + firstSize, second, secondSize);
+		d_head.store(head + firstSize + secondSize, std::memory_order_release);
+		return true;
+	}
+
+	// Copies size bytes at offset from the read position, without consuming
+	// them.
+	inline bool peek(void *data, size_t size, size_t offset = 0) const {
+		auto tail = d_tail.load(std::memory_order_relaxed);
+		if (d_head.load(std::memory_order_acquire) - tail < offset + size) {
+			return false;
+		}
+		copyOut(tail + offset, data, size);
+		return true;
+	}
+
+	inline bool read(void *data, size_t size) {
+		if (peek(data, size) == false) {
+			return false;
+		}
+		consume(size);
+		return true;
+	}
+
+	// Largest readable contiguous chunk, i.e. up to the end of the storage.
+	inline std::pair<const uint8_t *, size_t> contiguous() const {
+		auto tail = d_tail.load(std::memory_order_relaxed);
+		auto size = d_head.load(std::memory_order_acquire) - tail;
+		auto idx  = tail & (N - 1);
+		return {d_data.data() + idx, std::min<size_t>(size, N - idx)};
+	}
+
+	inline void consume(size_t size) {
+		d_tail.store(
+		    d_tail.load(std::memory_order_relaxed) + size,
+		    std::memory_order_release
+		);
+	}
+
+private:
+	inline void copyIn(uint32_t position, const void *data, size_t size) {
+		auto   idx   = position & (N - 1);
+		size_t first = std::min<size_t>(size, N - idx);
+		memcpy(d_data.data() + idx, data, first);
+		memcpy(
+		    d_data.data(),
+		    reinterpret_cast<const uint8_t *>(data) + first,
+		    size - first
+		);
+	}
+
+	inline void copyOut(uint32_t position, void *data, size_t size) const {
+		auto   idx   = position & (N - 1);
+		size_t first = std::min<size_t>(size, N - idx);
+		memcpy(data, d_data.data() + idx, first);
+		memcpy(
+		    reinterpret_cast<uint8_t *>(data) + first,
+		    d_data.data(),
+		    size - first
+		);
+	}
+
+	std::array<uint8_t, N> d_data;
+	// free running positions, only masked when accessing d_data.
+	std::atomic<uint32_t> d_head{0};
+	std::atomic<uint32_t> d_tail{0};
+};
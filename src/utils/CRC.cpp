@@ -0,0 +1,52 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#include "CRC.hpp"
+
+#include <array>
+
+namespace details {
+
+static constexpr std::array<uint16_t, 256> crc16Table() {
+	std::array<uint16_t, 256> table{};
+	for (uint16_t i = 0; i < 256; ++i) {
+		uint16_t crc = i << 8;
+		for (int bit = 0; bit < 8; ++bit) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+		table[i] = crc;
+	}
+	return table;
+}
+
+static constexpr std::array<uint32_t, 256> crc32Table() {
+	std::array<uint32_t, 256> table{};
+	for (uint32_t i = 0; i < 256; ++i) {
+		uint32_t crc = i;
+		for (int bit = 0; bit < 8; ++bit) {
+			crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+		}
+		table[i] = crc;
+	}
+	return table;
+}
+
+static constexpr auto CRC16_TABLE = crc16Table();
+static constexpr auto CRC32_TABLE = crc32Table();
+
+uint16_t CRC16(const uint8_t *data, size_t size, uint16_t crc) {
+	for (size_t i = 0; i < size; ++i) {
+		crc = (crc << 8) ^ CRC16_TABLE[(crc >> 8) ^ data[i]];
+	}
+	return crc;
+}
+
+uint32_t CRC32(const void *data, size_t size, uint32_t crc) {
+	auto bytes = reinterpret_cast<const uint8_t *>(data);
+	crc        = ~crc;
+	for (size_t i = 0; i < size; ++i) {
+		crc = (crc >> 8) ^ CRC32_TABLE[(crc ^ bytes[i]) & 0xff];
+	}
+	return ~crc;
+}
+
+} // namespace details
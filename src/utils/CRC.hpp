@@ -0,0 +1,16 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace details {
+// CRC-16/CCITT-FALSE. Pass a previous result as crc to continue a
+// computation over several buffers.
+uint16_t CRC16(const uint8_t *data, size_t size, uint16_t crc = 0xffff);
+
+// CRC-32 (IEEE 802.3). Pass a previous result as crc to continue a
+// computation over several buffers.
+uint32_t CRC32(const void *data, size_t size, uint32_t crc = 0);
+} // namespace details
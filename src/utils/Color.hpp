@@ -0,0 +1,51 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+
+// A colour, in perceived levels from 0 to 255.
+struct RGB {
+	uint8_t R, G, B;
+};
+
+// Hue in degrees, saturation and value from 0 to 255.
+struct HSV {
+	uint16_t H;
+	uint8_t  S, V;
+};
+
+constexpr RGB ToRGB(const HSV &hsv) {
+	uint8_t v = hsv.V;
+	if (hsv.S == 0) {
+		return {v, v, v};
+	}
+	uint16_t h = hsv.H % 360;
+	// position within the sixth of the hue circle, from 0 to 255.
+	uint32_t f = (h % 60) * 255 / 60;
+	uint8_t  p = v * (255 - hsv.S) / 255;
+	uint8_t  q = v * (255 - hsv.S * f / 255) / 255;
+	uint8_t  t = v * (255 - hsv.S * (255 - f) / 255) / 255;
+	switch (h / 60) {
+	case 0:
+		return {v, t, p};
+	case 1:
+		return {q, v, p};
+	case 2:
+		return {p, v, t};
+	case 3:
+		return {p, q, v};
+	case 4:
+		return {t, p, v};
+	default:
+		return {v, p, q};
+	}
+}
+
+// from a to b as t goes from 0 to 255.
+constexpr RGB Mix(const RGB &a, const RGB &b, uint8_t t) {
+	auto mix = [t](uint8_t x, uint8_t y) -> uint8_t {
+		return x + (int32_t(y) - int32_t(x)) * t / 255;
+	};
+	return {mix(a.R, b.R), mix(a.G, b.G), mix(a.B, b.B)};
+}
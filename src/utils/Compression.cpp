@@ -0,0 +1,228 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#include "Compression.hpp"
+
+#include <cstring>
+
+// A header byte h is followed by h + 1 literal bytes when h < 128, by a byte
+// repeated 257 - h times otherwise.
+size_t RLECompression::Encode(
+    const uint8_t *in, size_t size, uint8_t *out, size_t capacity
+) {
+	size_t o = 0;
+	for (size_t i = 0; i < size;) {
+		size_t run = 1;
+		while (i + run < size && run < 128 && in[i + run] == in[i]) {
+			++run;
+		}
+		if (run >= 2) {
+			if (o + 2 > capacity) {
+				return 0;
+			}
+			out[o++] = uint8_t(257 - run);
+			out[o++] = in[i];
+			i += run;
+			continue;
+		}
+		// literals up to the next run.
+		size_t n = 1;
+		while (i + n < size && n < 128 &&
+		       (i + n + 1 >= size || in[i + n] != in[i + n + 1])) {
+			++n;
+		}
+		if (o + 1 + n > capacity) {
+			return 0;
+		}
+		out[o++] = uint8_t(n - 1);
+		memcpy(out + o, in + i, n);
+		o += n;
+		i += n;
+	}
+	return o;
+}
+
+bool RLECompression::Decode(
+    const uint8_t *in, size_t size, uint8_t *out, size_t rawSize
+) {
+	size_t o = 0;
+	for (size_t i = 0; o < rawSize;) {
+		if (i >= size) {
+			return false;
+		}
+		uint8_t h = in[i++];
+		if (h < 128) {
+			size_t n = h + 1;
+			if (i + n > size || o + n > rawSize) {
+				return false;
+			}
+			memcpy(out + o, in + i, n);
+			i += n;
+			o += n;
+		} else {
+			size_t n = 257 - h;
+			if (i >= size || o + n > rawSize) {
+				return false;
+			}
+			memset(out + o, in[i++], n);
+			o += n;
+		}
+	}
+	return true;
+}
+
+// A token t is followed by t + 1 literal bytes when t < 128. Otherwise it
+// copies (t & 0x7f) + 3 bytes from the given distance back in the output,
+// written as distance - 1 in the next byte. Copies may overlap their output.
+static constexpr size_t LZ_WINDOW    = 256;
+static constexpr size_t LZ_MIN_MATCH = 3;
+static constexpr size_t LZ_MAX_MATCH = 127 + LZ_MIN_MATCH;
+
+// writes the count bytes before end as literals, 0 when they do not fit.
+static size_t lzLiterals(
+    const uint8_t *end, size_t count, uint8_t *out, size_t capacity
+) {
+	size_t o = 0;
+	for (auto p = end - count; p < end;) {
+		size_t n = end - p > 128 ? 128 : end - p;
+		if (o + 1 + n > capacity) {
+			return 0;
+		}
+		out[o++] = uint8_t(n - 1);
+		memcpy(out + o, p, n);
+		o += n;
+		p += n;
+	}
+	return o;
+}
+
+size_t LZCompression::Encode(
+    const uint8_t *in, size_t size, uint8_t *out, size_t capacity
+) {
+	size_t o = 0, literals = 0;
+	for (size_t i = 0; i < size;) {
+		size_t best = 0, distance = 0;
+		size_t max  = size - i < LZ_MAX_MATCH ? size - i : LZ_MAX_MATCH;
+		size_t from = i > LZ_WINDOW ? i - LZ_WINDOW : 0;
+		for (size_t j = from; j < i && best < max; ++j) {
+			size_t n = 0;
+			while (n < max && in[j + n] == in[i + n]) {
+				++n;
+			}
+			if (n > best) {
+				best     = n;
+				distance = i - j;
+			}
+		}
+		if (best < LZ_MIN_MATCH) {
+			++literals;
+			++i;
+			continue;
+		}
+		if (literals > 0) {
+			size_t n = lzLiterals(in + i, literals, out + o, capacity - o);
+			if (n == 0) {
+				return 0;
+			}
+			o += n;
+			literals = 0;
+		}
+		if (o + 2 > capacity) {
+			return 0;
+		}
+		out[o++] = uint8_t(0x80 | (best - LZ_MIN_MATCH));
+		out[o++] = uint8_t(distance - 1);
+		i += best;
+	}
+	if (literals > 0) {
+		size_t n = lzLiterals(in + size, literals, out + o, capacity - o);
+		return n == 0 ? 0 : o + n;
+	}
+	return o;
+}
+
+bool LZCompression::Decode(
+    const uint8_t *in, size_t size, uint8_t *out, size_t rawSize
+) {
+	size_t o = 0;
+	for (size_t i = 0; o < rawSize;) {
+		if (i >= size) {
+			return false;
+		}
+		uint8_t t = in[i++];
+		if (t < 128) {
+			size_t n = t + 1;
+			if (i + n > size || o + n > rawSize) {
+				return false;
+			}
+			memcpy(out + o, in + i, n);
+			i += n;
+			o += n;
+			continue;
+		}
+		if (i >= size) {
+			return false;
+		}
+		size_t n        = (t & 0x7f) + LZ_MIN_MATCH;
+		size_t distance = size_t(in[i++]) + 1;
+		if (distance > o || o + n > rawSize) {
+			return false;
+		}
+		for (size_t k = 0; k < n; ++k, ++o) {
+			out[o] = out[o - distance];
+		}
+	}
+	return true;
+}
+
+namespace details {
+
+size_t Encode(
+    Encoder encode, uint8_t codec, const void *raw, size_t size, uint8_t *out
+) {
+	// only kept when smaller than the raw data.
+	auto   bytes = reinterpret_cast<const uint8_t *>(raw);
+	auto   data  = out + sizeof(EncodedHeader);
+	size_t n     = encode(bytes, size, data, size - 1);
+	if (n == 0) {
+		codec = NoCompression::ID;
+		memcpy(data, raw, size);
+		n = size;
+	}
+	EncodedHeader h = {
+	    .Codec      = codec,
+	    .CodecCheck = uint8_t(~codec),
+	    .RawSize    = uint16_t(size),
+	};
+	memcpy(out, &h, sizeof(EncodedHeader));
+	return sizeof(EncodedHeader) + n;
+}
+
+bool Decode(const uint8_t *in, size_t size, void *raw, size_t rawSize) {
+	EncodedHeader h;
+	if (size < sizeof(EncodedHeader)) {
+		return false;
+	}
+	memcpy(&h, in, sizeof(EncodedHeader));
+	if (h.CodecCheck != uint8_t(~h.Codec) || h.RawSize != rawSize) {
+		return false;
+	}
+	auto data = in + sizeof(EncodedHeader);
+	auto out  = reinterpret_cast<uint8_t *>(raw);
+	size -= sizeof(EncodedHeader);
+	switch (h.Codec) {
+	case NoCompression::ID:
+		if (size != rawSize) {
+			return false;
+		}
+		memcpy(out, data, size);
+		return true;
+	case RLECompression::ID:
+		return RLECompression::Decode(data, size, out, rawSize);
+	case LZCompression::ID:
+		return LZCompression::Decode(data, size, out, rawSize);
+	default:
+		return false;
+	}
+}
+
+} // namespace details
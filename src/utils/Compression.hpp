@@ -0,0 +1,63 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Codecs of the objects stored by FlashStorage. They work in place between
+// the input and output buffers, without any other RAM. Encode() returns the
+// size of the encoded data, or 0 when it does not fit in capacity. Decode()
+// returns false when the data is corrupted.
+
+struct NoCompression {
+	static constexpr uint8_t ID = 0;
+};
+
+// PackBits: runs of a repeated byte take 2 bytes. Fast, for data holding
+// long runs such as zeroed or sparse structures.
+struct RLECompression {
+	static constexpr uint8_t ID = 1;
+
+	static size_t
+	Encode(const uint8_t *in, size_t size, uint8_t *out, size_t capacity);
+
+	static bool
+	Decode(const uint8_t *in, size_t size, uint8_t *out, size_t rawSize);
+};
+
+// LZ77 over the 256 previous bytes: also catches repeated sequences, e.g.
+// tables or arrays of records, at the cost of a slower encoding.
+struct LZCompression {
+	static constexpr uint8_t ID = 2;
+
+	static size_t
+	Encode(const uint8_t *in, size_t size, uint8_t *out, size_t capacity);
+
+	static bool
+	Decode(const uint8_t *in, size_t size, uint8_t *out, size_t rawSize);
+};
+
+namespace details {
+// Prefix of encoded objects, with the codec that decodes them.
+struct EncodedHeader {
+	uint8_t  Codec;
+	uint8_t  CodecCheck;
+	uint16_t RawSize;
+};
+
+typedef size_t (*Encoder)(
+    const uint8_t *in, size_t size, uint8_t *out, size_t capacity
+);
+
+// Encodes size bytes of raw into out, which holds sizeof(EncodedHeader) +
+// size bytes. Data that does not get smaller is stored as is. Returns the
+// encoded size.
+size_t Encode(
+    Encoder encode, uint8_t codec, const void *raw, size_t size, uint8_t *out
+);
+
+// Decodes data encoded by any codec, false when it does not hold rawSize
+// bytes.
+bool Decode(const uint8_t *in, size_t size, void *raw, size_t rawSize);
+} // namespace details
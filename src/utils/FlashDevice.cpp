@@ -0,0 +1,94 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#include "FlashDevice.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <pico/platform/panic.h>
+
+PicoFlash &PicoFlash::Get() {
+	static PicoFlash flash;
+	return flash;
+}
+
+size_t PicoFlash::Size() const {
+	return SIZE;
+}
+
+void PicoFlash::Read(size_t offset, void *data, size_t size) const {
+	memcpy(
+	    data,
+	    reinterpret_cast<const uint8_t *>(XIP_BASE + XIP_OFFSET + offset),
+	    size
+	);
+}
+
+const uint8_t *PicoFlash::Map(size_t offset) const {
+	return reinterpret_cast<const uint8_t *>(XIP_BASE + XIP_OFFSET + offset);
+}
+
+void PicoFlash::Program(size_t offset, const uint8_t *data, size_t size) {
+	flash_range_program(XIP_OFFSET + offset, data, size);
+}
+
+void PicoFlash::Erase(size_t offset, size_t size) {
+	flash_range_erase(XIP_OFFSET + offset, size);
+}
+
+SimulatedFlash::SimulatedFlash(size_t nbSectors)
+    : d_data(nbSectors * FLASH_SECTOR_SIZE, 0xff)
+    , d_eraseCounts(nbSectors, 0) {}
+
+size_t SimulatedFlash::Size() const {
+	return d_data.size();
+}
+
+void SimulatedFlash::Read(size_t offset, void *data, size_t size) const {
+	if (offset + size > d_data.size()) {
+		panic("SimulatedFlash: read out of bounds");
+	}
+	memcpy(data, d_data.data() + offset, size);
+	d_bytesRead += size;
+}
+
+const uint8_t *SimulatedFlash::Map(size_t offset) const {
+	return d_data.data() + offset;
+}
+
+void SimulatedFlash::Program(size_t offset, const uint8_t *data, size_t size) {
+	if (offset % FLASH_PAGE_SIZE != 0 || size % FLASH_PAGE_SIZE != 0 ||
+	    offset + size > d_data.size()) {
+		panic("SimulatedFlash: invalid program range");
+	}
+	d_bytesProgrammed += size;
+	d_busy_us += size / FLASH_PAGE_SIZE * PICO_NV_STORAGE_PAGE_PROGRAM_US;
+	size = powerCheck(size);
+	for (size_t i = 0; i < size; ++i) {
+		d_data[offset + i] &= data[i];
+	}
+}
+
+void SimulatedFlash::Erase(size_t offset, size_t size) {
+	if (offset % FLASH_SECTOR_SIZE != 0 || size % FLASH_SECTOR_SIZE != 0 ||
+	    offset + size > d_data.size()) {
+		panic("SimulatedFlash: invalid erase range");
+	}
+	for (size_t i = 0; i < size / FLASH_SECTOR_SIZE; ++i) {
+		d_eraseCounts[offset / FLASH_SECTOR_SIZE + i] += 1;
+	}
+	d_busy_us += size / FLASH_SECTOR_SIZE * PICO_NV_STORAGE_SECTOR_ERASE_US;
+	memset(d_data.data() + offset, 0xff, powerCheck(size));
+}
+
+size_t SimulatedFlash::powerCheck(size_t size) {
+	if (d_poweredOff) {
+		return 0;
+	}
+	if (d_cutAt.has_value() && d_operations == d_cutAt.value()) {
+		d_poweredOff = true;
+		size         = rand() % size;
+	}
+	++d_operations;
+	return size;
+}
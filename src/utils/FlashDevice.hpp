@@ -0,0 +1,158 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+extern "C" {
+#include <hardware/flash.h>
+#include <pico/types.h>
+}
+
+// FlashStorage needs at least two sectors: one is always kept erased to
+// compact the others.
+#ifndef PICO_NV_STORAGE_NB_SECTOR
+#define PICO_NV_STORAGE_NB_SECTOR 2
+#endif
+
+#if PICO_NV_STORAGE_NB_SECTOR < 2
+#error "PICO_NV_STORAGE_NB_SECTOR must be at least 2"
+#endif
+
+// Typical durations of flash operations, used by FlashStorage to fit steps
+// in a lockout and by SimulatedFlash to account for the time spent.
+#ifndef PICO_NV_STORAGE_PAGE_PROGRAM_US
+#define PICO_NV_STORAGE_PAGE_PROGRAM_US 1000
+#endif
+
+#ifndef PICO_NV_STORAGE_SECTOR_ERASE_US
+#define PICO_NV_STORAGE_SECTOR_ERASE_US 50000
+#endif
+
+// Flash region used for non-volatile storage. Offsets are relative to the
+// start of the region. Program() and Erase() follow the flash constraints:
+// page aligned programs and sector aligned erases.
+class FlashDevice {
+public:
+	virtual ~FlashDevice() = default;
+
+	virtual size_t Size() const = 0;
+
+	virtual void Read(size_t offset, void *data, size_t size) const = 0;
+
+	virtual void Program(size_t offset, const uint8_t *data, size_t size) = 0;
+
+	virtual void Erase(size_t offset, size_t size) = 0;
+
+	// Address of offset when the region is memory mapped, nullptr otherwise.
+	virtual const uint8_t *Map(size_t offset) const {
+		return nullptr;
+	}
+};
+
+// The last PICO_NV_STORAGE_NB_SECTOR sectors of the board flash, read
+// through XIP.
+class PicoFlash : public FlashDevice {
+public:
+	static constexpr size_t SIZE =
+	    PICO_NV_STORAGE_NB_SECTOR * FLASH_SECTOR_SIZE;
+	static constexpr uint XIP_OFFSET = PICO_FLASH_SIZE_BYTES - SIZE;
+
+	static PicoFlash &Get();
+
+	size_t Size() const override;
+
+	void Read(size_t offset, void *data, size_t size) const override;
+
+	void Program(size_t offset, const uint8_t *data, size_t size) override;
+
+	void Erase(size_t offset, size_t size) override;
+
+	const uint8_t *Map(size_t offset) const override;
+
+private:
+	PicoFlash() = default;
+};
+
+// A flash image in RAM, to exercise or benchmark the storage without
+// touching the board flash. Programs can only clear bits, like on NOR flash,
+// and power losses can be injected to test crash consistency. It counts the
+// bytes read and programmed, the erases of each sector, and the time the
+// flash would have been busy, during which the other core is locked out.
+class SimulatedFlash : public FlashDevice {
+public:
+	SimulatedFlash(size_t nbSectors);
+
+	size_t Size() const override;
+
+	void Read(size_t offset, void *data, size_t size) const override;
+
+	void Program(size_t offset, const uint8_t *data, size_t size) override;
+
+	void Erase(size_t offset, size_t size) override;
+
+	// not accounted in BytesRead().
+	const uint8_t *Map(size_t offset) const override;
+
+	inline size_t BytesRead() const {
+		return d_bytesRead;
+	}
+
+	inline size_t BytesProgrammed() const {
+		return d_bytesProgrammed;
+	}
+
+	// from PICO_NV_STORAGE_PAGE_PROGRAM_US and
+	// PICO_NV_STORAGE_SECTOR_ERASE_US.
+	inline uint64_t Busy_us() const {
+		return d_busy_us;
+	}
+
+	// Resets the counters above, erase counts are kept.
+	inline void ResetCounters() {
+		d_bytesRead       = 0;
+		d_bytesProgrammed = 0;
+		d_busy_us         = 0;
+	}
+
+	inline uint32_t EraseCount(size_t sector) const {
+		return d_eraseCounts.at(sector);
+	}
+
+	// Number of Program() and Erase() calls so far.
+	inline size_t Operations() const {
+		return d_operations;
+	}
+
+	// Cuts the power during the given operation, counted like
+	// Operations(): only a random prefix of it is applied, and all following
+	// programs and erases are ignored until PowerOn().
+	inline void CutPowerAt(size_t operation) {
+		d_cutAt = operation;
+	}
+
+	inline bool PoweredOff() const {
+		return d_poweredOff;
+	}
+
+	inline void PowerOn() {
+		d_cutAt.reset();
+		d_poweredOff = false;
+	}
+
+private:
+	// returns the number of bytes of the next operation to apply.
+	size_t powerCheck(size_t size);
+
+	std::vector<uint8_t>  d_data;
+	std::vector<uint32_t> d_eraseCounts;
+	mutable size_t        d_bytesRead       = 0;
+	size_t                d_bytesProgrammed = 0;
+	uint64_t              d_busy_us         = 0;
+	size_t                d_operations      = 0;
+	std::optional<size_t> d_cutAt;
+	bool                  d_poweredOff = false;
+};
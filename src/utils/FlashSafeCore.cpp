@@ -0,0 +1,106 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#include "FlashSafeCore.hpp"
+
+#include <cstdint>
+
+#include <hardware/irq.h>
+#include <hardware/regs/addressmap.h>
+#include <hardware/structs/sio.h>
+#include <hardware/sync.h>
+#include <pico/multicore.h>
+#include <pico/platform.h>
+#include <pico/version.h>
+
+// Private to pico_multicore, which pushes them to the victim core. They are
+// the ones of its multicore.c up to SDK 2.1, newer versions must be checked
+// before raising the bound.
+#if PICO_SDK_VERSION_MAJOR > 2 ||                                              \
+    (PICO_SDK_VERSION_MAJOR == 2 && PICO_SDK_VERSION_MINOR > 1)
+#error "FlashSafeCore: check the multicore lockout protocol of this SDK"
+#endif
+static constexpr uint32_t LOCKOUT_MAGIC_START = 0x73a8831eu;
+static constexpr uint32_t LOCKOUT_MAGIC_END   = ~LOCKOUT_MAGIC_START;
+
+struct Entry {
+	FlashSafeCore::Function Fn;
+	void                   *Data;
+};
+
+struct CoreFunctions {
+	Entry           Entries[PICO_FLASH_SAFE_CORE_MAX_FUNCTIONS];
+	volatile size_t Size        = 0;
+	bool            Initialized = false;
+};
+
+static CoreFunctions s_cores[2];
+
+// Only register accesses and RAM calls: the flash may be busy.
+static inline void __not_in_flash_func(fifoPush)(uint32_t value) {
+	while ((sio_hw->fifo_st & SIO_FIFO_ST_RDY_BITS) == 0) {
+	}
+	sio_hw->fifo_wr = value;
+	__sev();
+}
+
+static inline bool __not_in_flash_func(fifoValid)() {
+	return (sio_hw->fifo_st & SIO_FIFO_ST_VLD_BITS) != 0;
+}
+
+static void __isr __not_in_flash_func(lockoutHandler)() {
+	auto &core = s_cores[sio_hw->cpuid];
+	// clears the sticky flags that raise the interrupt.
+	sio_hw->fifo_st = 0xff;
+	while (fifoValid()) {
+		if (sio_hw->fifo_rd != LOCKOUT_MAGIC_START) {
+			continue;
+		}
+		auto saved = save_and_disable_interrupts();
+		fifoPush(LOCKOUT_MAGIC_START);
+		while (true) {
+			if (fifoValid() && sio_hw->fifo_rd == LOCKOUT_MAGIC_END) {
+				break;
+			}
+			for (size_t i = 0; i < core.Size; ++i) {
+				core.Entries[i].Fn(core.Entries[i].Data);
+			}
+		}
+		restore_interrupts(saved);
+		fifoPush(LOCKOUT_MAGIC_END);
+	}
+}
+
+void FlashSafeCore::Init() {
+	auto  coreNum = get_core_num();
+	auto &core    = s_cores[coreNum];
+	if (core.Initialized) {
+		return;
+	}
+	core.Initialized = true;
+
+	if (multicore_lockout_victim_is_initialized(coreNum) == false) {
+		multicore_lockout_victim_init();
+	}
+	uint irq = coreNum == 0 ? SIO_IRQ_PROC0 : SIO_IRQ_PROC1;
+	irq_set_enabled(irq, false);
+	irq_remove_handler(irq, irq_get_exclusive_handler(irq));
+	irq_set_exclusive_handler(irq, lockoutHandler);
+	irq_set_enabled(irq, true);
+}
+
+void FlashSafeCore::RunWhileLockedOut(Function fn, void *data) {
+	auto address = reinterpret_cast<uintptr_t>(fn);
+	if (address >= XIP_BASE && address < SRAM_BASE) {
+		panic("FlashSafeCore: function %p is in flash", fn);
+	}
+	Init();
+	auto &core = s_cores[get_core_num()];
+	if (core.Size == PICO_FLASH_SAFE_CORE_MAX_FUNCTIONS) {
+		panic("FlashSafeCore: too many functions");
+	}
+	// the lockout handler can not run meanwhile, it is on this core.
+	auto saved                = save_and_disable_interrupts();
+	core.Entries[core.Size] = {.Fn = fn, .Data = data};
+	core.Size               = core.Size + 1;
+	restore_interrupts(saved);
+}
@@ -0,0 +1,32 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+
+#ifndef PICO_FLASH_SAFE_CORE_MAX_FUNCTIONS
+#define PICO_FLASH_SAFE_CORE_MAX_FUNCTIONS 4
+#endif
+
+// Keeps time critical functions running on a core while the other one
+// programs or erases the flash. The multicore lockout handler of the core is
+// replaced by one speaking the same protocol, so multicore_lockout_*() and
+// FlashStorage are unchanged, but instead of idling while locked out it
+// keeps calling the registered functions.
+//
+// The flash is not readable during the lockout: the functions, and anything
+// they call or read, must live in RAM (__not_in_flash_func, no const data in
+// flash). They run with interrupts disabled, as often as possible, so they
+// should pace themselves on the timer.
+class FlashSafeCore {
+public:
+	typedef void (*Function)(void *data);
+
+	// Takes over the lockout of the calling core, making it a lockout
+	// victim if it is not yet one. Called by RunWhileLockedOut().
+	static void Init();
+
+	// Calls fn(data) on the calling core whenever it is locked out. Panics if
+	// fn is located in flash.
+	static void RunWhileLockedOut(Function fn, void *data);
+};
@@ -1,11 +1,19 @@
 // SPDX-License_identifier:  LGPL-3.0-or-later
 
 #include "FlashStorage.hpp"
+#include <algorithm>
+#include <cstddef>
 #include <boards/pico.h>
 #include <cstdint>
+#include <cstring>
 #include <hardware/flash.h>
+#include <hardware/sync.h>
 #include <pico/flash.h>
 #include <pico/types.h>
+#include <vector>
+
+#include <utils/CRC.hpp>
+#include <utils/Scheduler.hpp>
 
 namespace details {
 constexpr static size_t LINE_SIZE = 16;
@@ -72,4 +80,854 @@ void PrintFlashStorage() {
 	PrintMemory((uint8_t *)addr, size);
 }
 
+NVStorage::NVStorage(FlashDevice &device)
+    : d_device{device}
+    , d_sectors(device.Size() / FLASH_SECTOR_SIZE) {
+	if (d_sectors.size() < 2) {
+		panic("NVStorage: at least 2 sectors are required");
+	}
+}
+
+NVStorage &NVStorage::Default() {
+	static NVStorage storage(PicoFlash::Get());
+	return storage;
+}
+
+NVStorage::Header NVStorage::readHeader(size_t slot) const {
+	Header h;
+	d_device.Read(slot * SLOT_SIZE, &h, sizeof(Header));
+	return h;
+}
+
+bool NVStorage::isValid(size_t slot, const Header &h) const {
+	if (h.Size > h.SizeInSlots * SLOT_SIZE - sizeof(Header)) {
+		return false;
+	}
+	uint8_t buffer[FLASH_PAGE_SIZE];
+	auto    crc    = CRC32(&h, offsetof(Header, Flags));
+	size_t  offset = slot * SLOT_SIZE + sizeof(Header);
+	for (size_t i = 0; i < h.Size; i += FLASH_PAGE_SIZE) {
+		size_t n = std::min<size_t>(FLASH_PAGE_SIZE, h.Size - i);
+		d_device.Read(offset + i, buffer, n);
+		crc = CRC32(buffer, n, crc);
+	}
+	return crc == h.CRC;
+}
+
+bool NVStorage::isFree(size_t slot) const {
+	// the rest of the page, as a torn program may leave its first bytes
+	// erased.
+	uint8_t buffer[FLASH_PAGE_SIZE];
+	size_t  offset = slot * SLOT_SIZE;
+	size_t  size   = FLASH_PAGE_SIZE - offset % FLASH_PAGE_SIZE;
+	d_device.Read(offset, buffer, size);
+	return std::all_of(buffer, buffer + size, [](uint8_t b) {
+		return b == 0xff;
+	});
+}
+
+void NVStorage::Mount() {
+	if (d_mounted) {
+		return;
+	}
+	d_mounted = true;
+	d_index.clear();
+	d_active.reset();
+	d_sequence       = 0;
+	d_recordSequence = 0;
+
+	std::vector<size_t> log;
+	for (size_t i = 0; i < d_sectors.size(); ++i) {
+		SectorHeader h;
+		d_device.Read(i * FLASH_SECTOR_SIZE, &h, sizeof(SectorHeader));
+		d_sectors[i] = {
+		    .Sequence   = UNUSED,
+		    .EraseCount = 0,
+		    .Formatted  = false,
+		};
+		if (h.Magic != SECTOR_MAGIC || h.EraseCountCheck != ~h.EraseCount) {
+			continue;
+		}
+		d_sectors[i].EraseCount = h.EraseCount;
+		if (h.Sequence == UNUSED && h.SequenceCheck == UNUSED) {
+			d_sectors[i].Formatted = true;
+		} else if (h.SequenceCheck == ~h.Sequence) {
+			d_sectors[i].Formatted = true;
+			d_sectors[i].Sequence  = h.Sequence;
+			log.push_back(i);
+		}
+		// otherwise the sector was being opened, and holds no record yet.
+	}
+
+	std::sort(log.begin(), log.end(), [this](size_t a, size_t b) {
+		return d_sectors[a].Sequence < d_sectors[b].Sequence;
+	});
+
+	for (auto sector : log) {
+		d_free     = scan(sector);
+		d_active   = sector;
+		d_sequence = d_sectors[sector].Sequence;
+	}
+	// deletions are only needed to ignore the previous copies.
+	for (auto it = d_index.begin(); it != d_index.end();) {
+		if (it->second.Slot == DELETED) {
+			it = d_index.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	debugf(
+	    "[FlashStorage]: mounted %d object(s) in %d sector(s), next free slot "
+	    "is %d\n",
+	    d_index.size(),
+	    log.size(),
+	    d_free
+	);
+
+	recover();
+}
+
+void NVStorage::indexRecord(uint16_t uuid, const Location &location) {
+	// Sectors are scanned in log order, so on equal sequences the copy made
+	// by a compaction wins over the original.
+	auto it = d_index.find(uuid);
+	if (it == d_index.end() || location.Sequence >= it->second.Sequence) {
+		d_index[uuid] = location;
+	}
+}
+
+// Indexes the members of the transaction committed by the record at slot,
+// those programmed from the first sequence it holds up to it.
+void NVStorage::commit(
+    size_t slot, const Header &h, std::vector<Member> &members
+) {
+	uint32_t first = UNUSED;
+	if (h.Size == sizeof(first)) {
+		d_device.Read(slot * SLOT_SIZE + sizeof(Header), &first, sizeof(first));
+	}
+	for (const auto &[uuid, location] : members) {
+		if (location.Sequence >= first && location.Sequence < h.Sequence) {
+			indexRecord(uuid, location);
+		}
+	}
+	members.clear();
+}
+
+size_t NVStorage::scan(size_t sector) {
+	size_t base = sector * SLOTS_PER_SECTOR;
+	size_t slot = FIRST_SLOT;
+	// members of transactions of this sector waiting for their commit.
+	std::vector<Member> members;
+	while (slot < SLOTS_PER_SECTOR) {
+		auto h = readHeader(base + slot);
+		if (h.Begin == MAGIC_WORD && h.SizeInSlots > 0 &&
+		    slot + h.SizeInSlots <= SLOTS_PER_SECTOR) {
+			Location location = {
+			    .Slot     = uint16_t(base + slot),
+			    .Sequence = h.Sequence,
+			};
+			if (isValid(base + slot, h) == false) {
+				// torn records are skipped, not overwritten.
+				slot += h.SizeInSlots;
+				continue;
+			}
+			d_recordSequence = std::max(d_recordSequence, h.Sequence);
+			if (h.Identifier == COMMIT_UUID) {
+				commit(base + slot, h, members);
+			} else if (h.Identifier == DELETE_UUID) {
+				uint16_t deleted;
+				d_device.Read(
+				    (base + slot) * SLOT_SIZE + sizeof(Header),
+				    &deleted,
+				    sizeof(deleted)
+				);
+				indexRecord(deleted, {.Slot = DELETED, .Sequence = h.Sequence});
+			} else if (h.Flags == IN_TRANSACTION) {
+				members.push_back({h.Identifier, location});
+			} else {
+				indexRecord(h.Identifier, location);
+			}
+			slot += h.SizeInSlots;
+			continue;
+		}
+		if (isFree(base + slot)) {
+			break;
+		}
+		// left by a program interrupted before the header was complete.
+		++slot;
+	}
+	return base + slot;
+}
+
+void NVStorage::recover() {
+	if (unusedSectors() > 0) {
+		return;
+	}
+	// A compaction was interrupted after its live objects were copied, at
+	// least partially, but before the sector was erased.
+	auto   sector = oldestSector();
+	size_t live   = 0;
+	for (const auto &[uuid, location] : d_index) {
+		if (location.Slot / SLOTS_PER_SECTOR == sector) {
+			live += readHeader(location.Slot).SizeInSlots;
+		}
+	}
+	if (hasRoom(live) == false) {
+		debugf("[FlashStorage]: no room to finish compacting %d\n", sector);
+		return;
+	}
+	debugf("[FlashStorage]: resuming compaction of sector %d\n", sector);
+	while (relocateNext(sector)) {
+	}
+	erase(sector);
+}
+
+uint32_t NVStorage::EraseCount(size_t sector) {
+	Mount();
+	return d_sectors.at(sector).EraseCount;
+}
+
+size_t NVStorage::FreeBytes() {
+	Mount();
+	size_t res = 0;
+	if (d_active.has_value()) {
+		res = (d_active.value() + 1) * SLOTS_PER_SECTOR - d_free;
+	}
+	// the spare sector is not available for objects.
+	res += (std::max<size_t>(unusedSectors(), 1) - 1) *
+	       (SLOTS_PER_SECTOR - FIRST_SLOT);
+	return res * SLOT_SIZE;
+}
+
+bool NVStorage::Load(uint16_t uuid, void *obj, size_t size) {
+	Mount();
+	debugf("[FlashStorage]: Identifier=%08x\n", uuid);
+	auto it = d_index.find(uuid);
+	if (it == d_index.end() || readHeader(it->second.Slot).Size != size) {
+		debugf("[FlashStorage]: No record found\n");
+		return false;
+	}
+	debugf("[FlashStorage]: record at slot %d matches\n", it->second.Slot);
+	d_device.Read(it->second.Slot * SLOT_SIZE + sizeof(Header), obj, size);
+	return true;
+}
+
+std::optional<size_t> NVStorage::Read(uint16_t uuid, void *obj, size_t size) {
+	auto res = SizeOf(uuid);
+	if (res.has_value() && size > 0) {
+		d_device.Read(
+		    d_index[uuid].Slot * SLOT_SIZE + sizeof(Header),
+		    obj,
+		    std::min(size, res.value())
+		);
+	}
+	return res;
+}
+
+std::optional<size_t> NVStorage::SizeOf(uint16_t uuid) {
+	Mount();
+	auto it = d_index.find(uuid);
+	if (it == d_index.end()) {
+		return std::nullopt;
+	}
+	return readHeader(it->second.Slot).Size;
+}
+
+void NVStorage::ForEach(
+    const std::function<void(uint16_t uuid, size_t size)> &fn
+) {
+	Mount();
+	for (const auto &[uuid, location] : d_index) {
+		fn(uuid, readHeader(location.Slot).Size);
+	}
+}
+
+const void *NVStorage::Map(uint16_t uuid, size_t size, Location &location) {
+	Mount();
+	auto it = d_index.find(uuid);
+	if (it == d_index.end() || readHeader(it->second.Slot).Size != size) {
+		return nullptr;
+	}
+	location = it->second;
+	return d_device.Map(location.Slot * SLOT_SIZE + sizeof(Header));
+}
+
+bool NVStorage::IsCurrent(uint16_t uuid, const Location &location) const {
+	// not locked out by the other core halfway through the lookup.
+	auto saved = save_and_disable_interrupts();
+	auto it    = d_index.find(uuid);
+	bool res   = it != d_index.end() && it->second == location;
+	restore_interrupts(saved);
+	return res;
+}
+
+bool NVStorage::isSame(uint16_t uuid, const void *obj, size_t size) {
+	auto it = d_index.find(uuid);
+	if (it == d_index.end() || readHeader(it->second.Slot).Size != size) {
+		return false;
+	}
+
+	uint8_t buffer[FLASH_PAGE_SIZE];
+	size_t  offset = it->second.Slot * SLOT_SIZE + sizeof(Header);
+	for (size_t i = 0; i < size; i += FLASH_PAGE_SIZE) {
+		size_t n = std::min<size_t>(FLASH_PAGE_SIZE, size - i);
+		d_device.Read(offset + i, buffer, n);
+		if (memcmp(buffer, reinterpret_cast<const uint8_t *>(obj) + i, n) !=
+		    0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Programs count slots with the bytes produced by fill(dst, offset, size),
+// one page at a time through a stack buffer. The rest of the pages, which
+// may hold other records, is programmed with 0xff to leave it unchanged.
+template <typename Fill>
+void NVStorage::programSlots(size_t slot, size_t count, Fill &&fill) {
+	uint8_t buffer[FLASH_PAGE_SIZE];
+	size_t  begin = slot * SLOT_SIZE;
+	size_t  end   = begin + count * SLOT_SIZE;
+	for (size_t page = begin - begin % FLASH_PAGE_SIZE; page < end;
+	     page += FLASH_PAGE_SIZE) {
+		size_t from = std::max(begin, page);
+		size_t to   = std::min(end, page + FLASH_PAGE_SIZE);
+		memset(buffer, 0xff, FLASH_PAGE_SIZE);
+		fill(buffer + from - page, from - begin, to - from);
+		d_device.Program(page, buffer, FLASH_PAGE_SIZE);
+	}
+}
+
+static size_t pagesSpanned(size_t slot, size_t count) {
+	size_t begin = slot * NVStorage::SLOT_SIZE;
+	size_t end   = begin + count * NVStorage::SLOT_SIZE;
+	return (end - 1) / FLASH_PAGE_SIZE - begin / FLASH_PAGE_SIZE + 1;
+}
+
+NVStorage::Record NVStorage::record(
+    uint16_t uuid, const void *obj, size_t size, uint16_t flags
+) {
+	Record res = {
+	    .Head =
+	        {
+	            .SizeInSlots = uint8_t(SlotsFor(size)),
+	            .Identifier  = uuid,
+	            .Sequence    = ++d_recordSequence,
+	            .Size        = uint16_t(size),
+	            .Flags       = flags,
+	        },
+	    .Data = reinterpret_cast<const uint8_t *>(obj),
+	};
+	res.Head.CRC =
+	    CRC32(obj, size, CRC32(&res.Head, offsetof(Header, Flags)));
+	return res;
+}
+
+// Programs consecutive records at once, so the pages they share are
+// programmed a single time.
+void NVStorage::programRecords(
+    size_t slot, const Record *records, size_t count
+) {
+	size_t slots = 0;
+	for (size_t i = 0; i < count; ++i) {
+		slots += records[i].Head.SizeInSlots;
+	}
+	// offsets only increase, so the current record is followed along.
+	size_t current = 0, begin = 0;
+	programSlots(slot, slots, [&](uint8_t *dst, size_t offset, size_t n) {
+		for (size_t i = 0; i < n; ++i, ++offset) {
+			while (offset >=
+			       begin + records[current].Head.SizeInSlots * SLOT_SIZE) {
+				begin += records[current++].Head.SizeInSlots * SLOT_SIZE;
+			}
+			const auto &r      = records[current];
+			auto        header = reinterpret_cast<const uint8_t *>(&r.Head);
+			size_t      pos    = offset - begin;
+			// the padding of the last slot stays erased.
+			if (pos < sizeof(Header)) {
+				dst[i] = header[pos];
+			} else if (pos - sizeof(Header) < r.Head.Size) {
+				dst[i] = r.Data[pos - sizeof(Header)];
+			}
+		}
+	});
+}
+
+bool NVStorage::Save(uint16_t uuid, const void *obj, size_t size) {
+	Progress res;
+	do {
+		res = SaveSteps(uuid, obj, size, UINT32_MAX);
+	} while (res == Progress::PENDING);
+	return res == Progress::SAVED;
+}
+
+NVStorage::Progress NVStorage::SaveSteps(
+    uint16_t uuid, const void *obj, size_t size, uint32_t budget_us
+) {
+	Mount();
+	uint32_t spent = 0;
+	while (true) {
+		spent += nextStepCost(size);
+		auto res = step(uuid, obj, size);
+		if (res != Progress::PENDING) {
+			d_opened = 0;
+			return res;
+		}
+		if (spent + nextStepCost(size) > budget_us) {
+			return Progress::PENDING;
+		}
+	}
+}
+
+NVStorage::Progress NVStorage::step(
+    uint16_t uuid, const void *obj, size_t size
+) {
+	if (d_compacting.has_value() == false && isSame(uuid, obj, size)) {
+		debugf("[FlashStorage]: UUID=%d is unchanged\n", uuid);
+		return Progress::UNCHANGED;
+	}
+
+	auto res = makeRoom(SlotsFor(size));
+	if (res != Progress::SAVED) {
+		return res;
+	}
+	auto r = record(uuid, obj, size, STANDALONE);
+	programRecords(d_free, &r, 1);
+	d_index[uuid] = {
+	    .Slot     = uint16_t(d_free),
+	    .Sequence = r.Head.Sequence,
+	};
+	debugf("[FlashStorage]: saved UUID=%d at slot %d\n", uuid, d_free);
+	d_free += r.Head.SizeInSlots;
+	return Progress::SAVED;
+}
+
+// Runs one step of compaction or opens a sector until slots fit in the
+// active sector, then returns SAVED.
+NVStorage::Progress NVStorage::makeRoom(size_t slots) {
+	if (d_compacting.has_value()) {
+		if (relocateNext(d_compacting.value()) == false) {
+			erase(d_compacting.value());
+			d_compacting.reset();
+		}
+		return Progress::PENDING;
+	}
+
+	if (hasRoom(slots)) {
+		return Progress::SAVED;
+	}
+
+	// Opening or compacting every sector without finding room means the
+	// storage is full.
+	if (unusedSectors() == 0 || ++d_opened > d_sectors.size()) {
+		debugf("[FlashStorage]: no space left for %d slots\n", slots);
+		return Progress::FAILED;
+	}
+	if (unusedSectors() > 1) {
+		open(unusedSector().value());
+	} else {
+		// live objects of the oldest sector move to the spare one.
+		d_compacting = oldestSector();
+		debugf("[FlashStorage]: compacting sector %d\n", *d_compacting);
+		open(unusedSector().value());
+	}
+	return Progress::PENDING;
+}
+
+NVStorage::Progress NVStorage::SaveAll(const Entry *entries, size_t count) {
+	Mount();
+	if (count > PICO_NV_STORAGE_MAX_TRANSACTION) {
+		return Progress::FAILED;
+	}
+
+	bool   changed[PICO_NV_STORAGE_MAX_TRANSACTION];
+	size_t nbChanged = 0, last = 0;
+	size_t slots     = SlotsFor(sizeof(uint32_t));
+	for (size_t i = 0; i < count; ++i) {
+		const auto &e = entries[i];
+		changed[i]    = isSame(e.UUID, e.Object, e.Size) == false;
+		if (changed[i]) {
+			++nbChanged;
+			last = i;
+			slots += SlotsFor(e.Size);
+		}
+	}
+	if (nbChanged == 0) {
+		return Progress::UNCHANGED;
+	}
+	if (nbChanged == 1) {
+		// a single record is atomic on its own.
+		const auto &e = entries[last];
+		Progress    res;
+		do {
+			res = SaveSteps(e.UUID, e.Object, e.Size, UINT32_MAX);
+		} while (res == Progress::PENDING);
+		return res;
+	}
+	if (slots > SLOTS_PER_SECTOR - FIRST_SLOT) {
+		debugf("[FlashStorage]: transaction of %d slots is too large\n", slots);
+		return Progress::FAILED;
+	}
+
+	Progress res;
+	do {
+		res = makeRoom(slots);
+	} while (res == Progress::PENDING);
+	d_opened = 0;
+	if (res == Progress::FAILED) {
+		return res;
+	}
+
+	Record   records[PICO_NV_STORAGE_MAX_TRANSACTION + 1];
+	size_t   n     = 0;
+	uint32_t first = d_recordSequence + 1;
+	for (size_t i = 0; i < count; ++i) {
+		if (changed[i]) {
+			const auto &e = entries[i];
+			records[n++]  = record(e.UUID, e.Object, e.Size, IN_TRANSACTION);
+		}
+	}
+	records[n] = record(COMMIT_UUID, &first, sizeof(first), STANDALONE);
+	programRecords(d_free, records, n + 1);
+
+	// the members only replace the current copies once committed.
+	for (size_t i = 0; i <= n; ++i) {
+		const auto &h = records[i].Head;
+		if (i < n) {
+			d_index[h.Identifier] = {
+			    .Slot     = uint16_t(d_free),
+			    .Sequence = h.Sequence,
+			};
+		}
+		d_free += h.SizeInSlots;
+	}
+	debugf("[FlashStorage]: committed %d objects\n", n);
+	return Progress::SAVED;
+}
+
+bool NVStorage::Delete(uint16_t uuid) {
+	Mount();
+	if (d_index.count(uuid) == 0) {
+		return false;
+	}
+	Progress res;
+	do {
+		res = makeRoom(SlotsFor(sizeof(uuid)));
+	} while (res == Progress::PENDING);
+	d_opened = 0;
+	if (res == Progress::FAILED) {
+		return false;
+	}
+	// Compactions erase the oldest sector first, so the previous copies are
+	// gone before the deletion, which is never moved.
+	auto r = record(DELETE_UUID, &uuid, sizeof(uuid), STANDALONE);
+	programRecords(d_free, &r, 1);
+	d_free += r.Head.SizeInSlots;
+	d_index.erase(uuid);
+	debugf("[FlashStorage]: deleted UUID=%d\n", uuid);
+	return true;
+}
+
+uint32_t NVStorage::nextStepCost(size_t size) const {
+	constexpr uint32_t program = PICO_NV_STORAGE_PAGE_PROGRAM_US;
+	constexpr uint32_t erase   = PICO_NV_STORAGE_SECTOR_ERASE_US;
+	if (d_compacting.has_value()) {
+		auto slot = nextLive(d_compacting.value());
+		if (slot.has_value() == false) {
+			return erase + program;
+		}
+		return pagesSpanned(d_free, readHeader(slot.value()).SizeInSlots) *
+		       program;
+	}
+	if (hasRoom(SlotsFor(size))) {
+		return pagesSpanned(d_free, SlotsFor(size)) * program;
+	}
+	auto sector = unusedSector();
+	if (sector.has_value() && d_sectors[sector.value()].Formatted == false) {
+		return erase + program;
+	}
+	return program;
+}
+
+bool NVStorage::hasRoom(size_t slots) const {
+	return d_active.has_value() &&
+	       d_free + slots <= (d_active.value() + 1) * SLOTS_PER_SECTOR;
+}
+
+std::optional<size_t> NVStorage::unusedSector() const {
+	// the least erased one, to level the wear.
+	std::optional<size_t> res;
+	for (size_t i = 0; i < d_sectors.size(); ++i) {
+		if (d_sectors[i].Sequence != UNUSED) {
+			continue;
+		}
+		if (res.has_value() == false ||
+		    d_sectors[i].EraseCount < d_sectors[res.value()].EraseCount) {
+			res = i;
+		}
+	}
+	return res;
+}
+
+size_t NVStorage::unusedSectors() const {
+	return std::count_if(d_sectors.begin(), d_sectors.end(), [](const auto &s) {
+		return s.Sequence == UNUSED;
+	});
+}
+
+size_t NVStorage::oldestSector() const {
+	size_t res = 0;
+	for (size_t i = 1; i < d_sectors.size(); ++i) {
+		if (d_sectors[i].Sequence < d_sectors[res].Sequence) {
+			res = i;
+		}
+	}
+	return res;
+}
+
+void NVStorage::writeSectorHeader(size_t sector) {
+	// Programming an already programmed header page only clears the bits of
+	// the Sequence, which is UNUSED until the sector is opened.
+	uint8_t      buffer[FLASH_PAGE_SIZE];
+	const auto  &s = d_sectors[sector];
+	SectorHeader h = {
+	    .Magic           = SECTOR_MAGIC,
+	    .EraseCount      = s.EraseCount,
+	    .EraseCountCheck = ~s.EraseCount,
+	    .Sequence        = s.Sequence,
+	    .SequenceCheck   = s.Sequence == UNUSED ? UNUSED : ~s.Sequence,
+	};
+	memset(buffer, 0xff, FLASH_PAGE_SIZE);
+	memcpy(buffer, &h, sizeof(SectorHeader));
+	d_device.Program(sector * FLASH_SECTOR_SIZE, buffer, FLASH_PAGE_SIZE);
+}
+
+void NVStorage::open(size_t sector) {
+	auto &s = d_sectors[sector];
+	if (s.Formatted == false) {
+		d_device.Erase(sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
+		s.EraseCount += 1;
+		s.Formatted = true;
+	}
+	s.Sequence = ++d_sequence;
+	writeSectorHeader(sector);
+	d_active = sector;
+	d_free   = sector * SLOTS_PER_SECTOR + FIRST_SLOT;
+	debugf(
+	    "[FlashStorage]: opened sector %d (sequence %d)\n",
+	    sector,
+	    d_sequence
+	);
+}
+
+std::optional<uint16_t> NVStorage::nextLive(size_t sector) const {
+	for (const auto &[uuid, location] : d_index) {
+		if (location.Slot / SLOTS_PER_SECTOR == sector) {
+			return location.Slot;
+		}
+	}
+	return std::nullopt;
+}
+
+bool NVStorage::relocateNext(size_t sector) {
+	auto slot = nextLive(sector);
+	if (slot.has_value() == false) {
+		return false;
+	}
+
+	// The record is copied verbatim, keeping its sequence and CRC. Each page
+	// is read before it is programmed, as the flash can not be read during a
+	// program. Its commit is not copied, so a member of a transaction becomes
+	// standalone, which the CRC allows.
+	auto   h    = readHeader(slot.value());
+	size_t from = slot.value() * SLOT_SIZE;
+	programSlots(
+	    d_free,
+	    h.SizeInSlots,
+	    [&](uint8_t *dst, size_t offset, size_t n) {
+		    d_device.Read(from + offset, dst, n);
+		    for (size_t i = 0; i < n; ++i, ++offset) {
+			    if (offset >= offsetof(Header, Flags) &&
+			        offset < offsetof(Header, CRC)) {
+				    dst[i] = 0xff;
+			    }
+		    }
+	    }
+	);
+	debugf("[FlashStorage]: moved UUID=%d to slot %d\n", h.Identifier, d_free);
+	d_index[h.Identifier].Slot = d_free;
+	d_free += h.SizeInSlots;
+	return true;
+}
+
+void NVStorage::erase(size_t sector) {
+	d_device.Erase(sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
+	d_sectors[sector] = {
+	    .Sequence   = UNUSED,
+	    .EraseCount = d_sectors[sector].EraseCount + 1,
+	    .Formatted  = true,
+	};
+	writeSectorHeader(sector);
+}
+
 } // namespace details
+
+bool FlashTransaction::Commit() {
+	for (size_t i = 0; i < d_count; ++i) {
+		FlashStorageWriter::Cancel(*d_staged[i]);
+	}
+	multicore_lockout_start_blocking();
+	auto res = details::NVStorage::Default().SaveAll(d_entries, d_count);
+	multicore_lockout_end_blocking();
+	return res != details::NVStorage::Progress::FAILED;
+}
+
+spin_lock_t *FlashStorageWriter::s_lock =
+    spin_lock_instance(next_striped_spin_lock_num());
+details::StagedObject   *FlashStorageWriter::s_objects         = nullptr;
+FlashStorageWriter::Stats FlashStorageWriter::s_stats           = {};
+uint64_t                  FlashStorageWriter::s_totalLatency_us = 0;
+
+void FlashStorageWriter::Stage(
+    details::StagedObject &object, const void *data, size_t size
+) {
+	auto saved = spin_lock_blocking(s_lock);
+	if (object.Registered == false) {
+		object.Registered = true;
+		object.Next       = s_objects;
+		s_objects         = &object;
+	}
+	++s_stats.Staged;
+	if (object.Pending) {
+		++s_stats.Coalesced;
+	} else {
+		object.Pending = true;
+		object.Since   = get_absolute_time();
+	}
+	object.Size = size;
+	memcpy(object.Data, data, size);
+	spin_unlock(s_lock, saved);
+}
+
+bool FlashStorageWriter::ReadStaged(
+    details::StagedObject &object, void *data
+) {
+	auto saved = spin_lock_blocking(s_lock);
+	bool res   = object.Pending;
+	if (res) {
+		memcpy(data, object.Data, object.Size);
+	}
+	spin_unlock(s_lock, saved);
+	return res;
+}
+
+bool FlashStorageWriter::Cancel(details::StagedObject &object) {
+	auto saved     = spin_lock_blocking(s_lock);
+	bool res       = object.Pending;
+	object.Pending = false;
+	spin_unlock(s_lock, saved);
+	return res;
+}
+
+details::StagedObject *FlashStorageWriter::oldestPending() {
+	auto                   saved = spin_lock_blocking(s_lock);
+	details::StagedObject *res   = nullptr;
+	for (auto o = s_objects; o != nullptr; o = o->Next) {
+		if (o->Pending == false) {
+			continue;
+		}
+		if (res == nullptr || absolute_time_diff_us(o->Since, res->Since) > 0) {
+			res = o;
+		}
+	}
+	spin_unlock(s_lock, saved);
+	return res;
+}
+
+bool FlashStorageWriter::WriteNext() {
+	auto object = oldestPending();
+	if (object == nullptr) {
+		return false;
+	}
+
+	auto start = get_absolute_time();
+	multicore_lockout_start_blocking();
+	// a Save() on the other core may have cancelled the object and written
+	// a newer value since it was picked.
+	auto saved   = spin_lock_blocking(s_lock);
+	bool pending = object->Pending;
+	spin_unlock(s_lock, saved);
+	if (pending == false) {
+		multicore_lockout_end_blocking();
+		return Pending() > 0;
+	}
+	auto res = details::NVStorage::Default().SaveSteps(
+	    object->UUID,
+	    object->Data,
+	    object->Size,
+	    PICO_NV_STORAGE_MAX_LOCKOUT_US
+	);
+	if (res != details::NVStorage::Progress::PENDING) {
+		// The other core is locked out since Pending was checked, so it can
+		// not stage or save the object meanwhile.
+		object->Pending = false;
+	}
+	multicore_lockout_end_blocking();
+	auto end = get_absolute_time();
+
+	s_stats.MaxLockout_us = std::max<uint32_t>(
+	    s_stats.MaxLockout_us,
+	    absolute_time_diff_us(start, end)
+	);
+	if (res == details::NVStorage::Progress::PENDING) {
+		return true;
+	}
+
+	switch (res) {
+	case details::NVStorage::Progress::SAVED:
+		++s_stats.Written;
+		break;
+	case details::NVStorage::Progress::UNCHANGED:
+		++s_stats.Unchanged;
+		break;
+	default:
+		++s_stats.Failed;
+	}
+	uint32_t latency = absolute_time_diff_us(object->Since, end);
+	s_stats.MaxLatency_us = std::max(s_stats.MaxLatency_us, latency);
+	s_totalLatency_us += latency;
+	return Pending() > 0;
+}
+
+void FlashStorageWriter::Flush() {
+	while (WriteNext()) {
+	}
+}
+
+size_t FlashStorageWriter::Pending() {
+	auto   saved = spin_lock_blocking(s_lock);
+	size_t res   = 0;
+	for (auto o = s_objects; o != nullptr; o = o->Next) {
+		res += o->Pending;
+	}
+	spin_unlock(s_lock, saved);
+	return res;
+}
+
+FlashStorageWriter::Stats FlashStorageWriter::GetStats() {
+	auto res = s_stats;
+	auto n   = res.Written + res.Unchanged + res.Failed;
+	if (n > 0) {
+		res.MeanLatency_us = s_totalLatency_us / n;
+	}
+	return res;
+}
+
+void FlashStorageWriter::ScheduleWriting() {
+	Scheduler::Get().Schedule(
+	    PICO_NV_STORAGE_WRITE_PERIOD_US,
+	    []() { WriteNext(); },
+	    {.Priority = SCHEDULER_LOW_PRIORITY, .Name = "storage/write"}
+	);
+}
@@ -4,39 +4,428 @@
 
 #include <cstddef>
 #include <cstdint>
-#include <cstring>
 #include <functional>
-#include <map>
-#include <memory>
+#include <optional>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 extern "C" {
 #include <hardware/flash.h>
+#include <hardware/sync.h>
 #include <pico/multicore.h>
+#include <pico/platform/panic.h>
 #include <pico/time.h>
 #include <stdio.h>
 }
 
+#include <utils/Compression.hpp>
 #include <utils/Defer.hpp>
+#include <utils/FlashDevice.hpp>
 #include <utils/internal/debugf.hpp>
 
-#ifndef PICO_NV_STORAGE_NB_SECTOR
-#define PICO_NV_STORAGE_NB_SECTOR 1
+// Longest the other core should be locked out by a single run of the
+// write-behind task. A sector erase can not be split, so it always runs on
+// its own even when it is longer.
+#ifndef PICO_NV_STORAGE_MAX_LOCKOUT_US
+#define PICO_NV_STORAGE_MAX_LOCKOUT_US 10000
+#endif
+
+#ifndef PICO_NV_STORAGE_WRITE_PERIOD_US
+#define PICO_NV_STORAGE_WRITE_PERIOD_US 10000
+#endif
+
+// Most objects saved together by a FlashTransaction.
+#ifndef PICO_NV_STORAGE_MAX_TRANSACTION
+#define PICO_NV_STORAGE_MAX_TRANSACTION 8
 #endif
 
 namespace details {
 void PrintMemory(const uint8_t *addr, size_t size);
 void PrintFlashStorage();
+
+// Storage shared by all FlashStorage types, organized as a log over the
+// sectors of the region. Each sector starts with a header holding its
+// sequence number in the log and its erase count. Objects are appended to the
+// newest sector. When no sector is left, the oldest one is compacted: its
+// live objects are copied into the spare erased sector, then it is erased and
+// becomes the new spare. Sectors are therefore reclaimed one at a time and
+// all of them get erased in turn.
+//
+// Records are packed on 16 bytes slots rather than whole pages, so several
+// small objects share a page. NOR flash programs only clear bits: a page is
+// programmed again with 0xff everywhere but in the new record, which leaves
+// the previous ones unchanged.
+//
+// The location of the newest copy of each object is indexed in RAM in a
+// single pass over the region on first use, then kept up to date on every
+// program and erase, so loads and saves never scan the flash.
+//
+// Every record carries a CRC and a sequence number, and the flash is only
+// ever modified by appending, so a power loss at any point keeps the
+// previous copy of each object: the mount ignores torn records and picks the
+// valid copy with the highest sequence. A compaction interrupted before the
+// old sector was erased leaves no spare sector, which the mount detects and
+// finishes.
+class NVStorage {
+public:
+	struct Header {
+		uint8_t  Begin = MAGIC_WORD;
+		uint8_t  SizeInSlots;
+		uint16_t Identifier;
+		uint32_t Sequence;
+		uint16_t Size;
+		// Not covered by the CRC: bits may be cleared once programmed.
+		uint16_t Flags = STANDALONE;
+		// of the fields above but Flags, and of the Size bytes of the object.
+		uint32_t CRC;
+	};
+
+	static constexpr uint16_t STANDALONE = 0xffff;
+	// Member of a transaction, only valid once followed by its commit.
+	static constexpr uint16_t IN_TRANSACTION = 0xfffe;
+
+	// Identifiers from FIRST_RESERVED_UUID are not available to FlashStorage:
+	// BlobStorage uses them, up to the ones of the internal records.
+	static constexpr uint16_t FIRST_RESERVED_UUID = 0xc000;
+	static constexpr uint16_t DELETE_UUID         = 0xfffe;
+	static constexpr uint16_t COMMIT_UUID         = 0xffff;
+
+	// An object saved by SaveAll().
+	struct Entry {
+		uint16_t    UUID;
+		const void *Object;
+		size_t      Size;
+	};
+
+	enum class Progress { SAVED, UNCHANGED, PENDING, FAILED };
+
+	// Where the current copy of an object is. Saving the object changes its
+	// sequence, a compaction its slot.
+	struct Location {
+		uint16_t Slot;
+		uint32_t Sequence;
+
+		inline bool operator==(const Location &other) const {
+			return Slot == other.Slot && Sequence == other.Sequence;
+		}
+	};
+
+	static constexpr size_t SLOT_SIZE        = 16;
+	static constexpr size_t SLOTS_PER_SECTOR = FLASH_SECTOR_SIZE / SLOT_SIZE;
+	// slots of each sector taken by its header.
+	static constexpr size_t FIRST_SLOT = 2;
+
+	NVStorage(FlashDevice &device);
+
+	static NVStorage &Default();
+
+	// Indexes the region, finishing an interrupted compaction. Done by the
+	// first operation otherwise.
+	void Mount();
+
+	inline bool Mounted() const {
+		return d_mounted;
+	}
+
+	bool Load(uint16_t uuid, void *obj, size_t size);
+
+	// Copies at most size bytes of an object of any size, returns its size
+	// or nullopt when it is not stored.
+	std::optional<size_t> Read(uint16_t uuid, void *obj, size_t size);
+
+	std::optional<size_t> SizeOf(uint16_t uuid);
+
+	// Calls fn with the identifier and the size of every stored object.
+	void ForEach(const std::function<void(uint16_t uuid, size_t size)> &fn);
+
+	bool Save(uint16_t uuid, const void *obj, size_t size);
+
+	// Performs the steps of a save that fit in the estimated budget_us, at
+	// least one. A compaction is split in steps moving one object or erasing
+	// the sector, the saved object is programmed in a single step. Returns
+	// PENDING until the save is over.
+	Progress
+	SaveSteps(uint16_t uuid, const void *obj, size_t size, uint32_t budget_us);
+
+	// Saves up to PICO_NV_STORAGE_MAX_TRANSACTION objects atomically: after a
+	// power loss either all of them or none are visible. Changed objects are
+	// programmed in one go, followed by a commit record, so they must fit
+	// together in a sector.
+	Progress SaveAll(const Entry *entries, size_t count);
+
+	// Appends a record deleting the object, returns false when it is not
+	// stored or there is no room left.
+	bool Delete(uint16_t uuid);
+
+	size_t FreeBytes();
+
+	inline size_t Sectors() const {
+		return d_sectors.size();
+	}
+
+	uint32_t EraseCount(size_t sector);
+
+	// Address of the stored object in the memory mapped flash, or nullptr
+	// when it is not stored with this size or the device is not mapped.
+	const void *Map(uint16_t uuid, size_t size, Location &location);
+
+	// true while the object is still at location. Callable from any core.
+	bool IsCurrent(uint16_t uuid, const Location &location) const;
+
+	// Slots taken by a record of an object of the given size.
+	static constexpr size_t SlotsFor(size_t size) {
+		return (sizeof(Header) + size + SLOT_SIZE - 1) / SLOT_SIZE;
+	}
+
+private:
+	static constexpr uint8_t  MAGIC_WORD   = 0xaa;
+	static constexpr uint32_t SECTOR_MAGIC = 0x4e565334;
+	static constexpr uint32_t UNUSED       = 0xffffffff;
+	// slot of deleted objects while mounting.
+	static constexpr uint16_t DELETED = 0xffff;
+
+	// Fields are followed by their complement to detect a header torn by a
+	// power loss. Sequence is programmed when the sector is opened.
+	struct SectorHeader {
+		uint32_t Magic;
+		uint32_t EraseCount;
+		uint32_t EraseCountCheck;
+		uint32_t Sequence;
+		uint32_t SequenceCheck;
+	};
+
+	static_assert(sizeof(SectorHeader) <= FIRST_SLOT * SLOT_SIZE);
+
+	struct Sector {
+		// UNUSED when the sector is not part of the log.
+		uint32_t Sequence;
+		uint32_t EraseCount;
+		// false when the sector was never formatted and must be erased
+		// before use.
+		bool Formatted;
+	};
+
+	size_t scan(size_t sector);
+	void   recover();
+
+	Header readHeader(size_t slot) const;
+	bool   isValid(size_t slot, const Header &h) const;
+	bool   isFree(size_t slot) const;
+
+	bool isSame(uint16_t uuid, const void *obj, size_t size);
+
+	typedef std::pair<uint16_t, Location> Member;
+	void indexRecord(uint16_t uuid, const Location &location);
+	void commit(size_t slot, const Header &h, std::vector<Member> &members);
+
+	struct Record {
+		Header         Head;
+		const uint8_t *Data;
+	};
+
+	Record record(uint16_t uuid, const void *obj, size_t size, uint16_t flags);
+
+	void programRecords(size_t slot, const Record *records, size_t count);
+
+	template <typename Fill>
+	void programSlots(size_t slot, size_t count, Fill &&fill);
+
+	Progress makeRoom(size_t slots);
+	Progress step(uint16_t uuid, const void *obj, size_t size);
+	uint32_t nextStepCost(size_t size) const;
+	bool     hasRoom(size_t slots) const;
+
+	std::optional<size_t> unusedSector() const;
+	size_t                unusedSectors() const;
+	size_t                oldestSector() const;
+
+	void                    open(size_t sector);
+	std::optional<uint16_t> nextLive(size_t sector) const;
+	bool                    relocateNext(size_t sector);
+	void                    erase(size_t sector);
+	void                    writeSectorHeader(size_t sector);
+
+	FlashDevice                           &d_device;
+	std::vector<Sector>                    d_sectors;
+	bool                                   d_mounted        = false;
+	uint32_t                               d_sequence       = 0;
+	uint32_t                               d_recordSequence = 0;
+	std::optional<size_t>                  d_active;
+	size_t                                 d_free = 0;
+	std::unordered_map<uint16_t, Location> d_index;
+	// sector being compacted, saves wait until it is erased.
+	std::optional<size_t> d_compacting;
+	// sectors opened by the current save, to detect a full storage.
+	size_t d_opened = 0;
+};
+
+// Read-only view of an object stored in flash, read in place through XIP
+// without copying it to RAM. The view becomes stale once the object is saved
+// again or moved by a compaction, after which its bytes may be erased at any
+// time. Valid() detects it: check it after reading, and read again from a
+// new view when it failed.
+template <typename T> class FlashView {
+public:
+	FlashView() = default;
+
+	FlashView(NVStorage &storage, uint16_t uuid)
+	    : d_storage{&storage}
+	    , d_uuid{uuid} {
+		d_object = reinterpret_cast<const T *>(
+		    storage.Map(uuid, sizeof(T), d_location)
+		);
+	}
+
+	inline bool Valid() const {
+		return d_object != nullptr &&
+		       d_storage->IsCurrent(d_uuid, d_location);
+	}
+
+	inline const T *Get() const {
+		return d_object;
+	}
+
+	inline const T &operator*() const {
+		return *d_object;
+	}
+
+	inline const T *operator->() const {
+		return d_object;
+	}
+
+private:
+	NVStorage          *d_storage = nullptr;
+	uint16_t            d_uuid    = 0;
+	NVStorage::Location d_location;
+	const T            *d_object = nullptr;
+};
+
+// An object staged by FlashStorage::SaveAsync(), as stored: Size varies
+// with the encoding of compressed objects.
+struct StagedObject {
+	uint16_t        UUID;
+	size_t          Size;
+	uint8_t        *Data;
+	bool            Pending    = false;
+	bool            Registered = false;
+	absolute_time_t Since      = 0;
+	StagedObject   *Next       = nullptr;
+};
+
 } // namespace details
 
-template <typename T, uint16_t UUID, size_t PagesPerObject = 1>
+// Write-behind queue of the FlashStorage objects saved with SaveAsync(). A
+// low priority task programs them one lockout of the other core at a time,
+// each lockout lasting at most PICO_NV_STORAGE_MAX_LOCKOUT_US, so a
+// compaction is spread over several runs.
+class FlashStorageWriter {
+public:
+	struct Stats {
+		uint32_t Staged;
+		// staged while a previous value was still pending.
+		uint32_t Coalesced;
+		uint32_t Written;
+		uint32_t Unchanged;
+		uint32_t Failed;
+		// from the first staging to the end of the write.
+		uint32_t MaxLatency_us;
+		uint32_t MeanLatency_us;
+		uint32_t MaxLockout_us;
+	};
+
+	static void
+	Stage(details::StagedObject &object, const void *data, size_t size);
+
+	// Copies the object if it is pending, returns true if it was.
+	static bool ReadStaged(details::StagedObject &object, void *data);
+
+	// Drops a pending write of the object, returns true if there was one.
+	static bool Cancel(details::StagedObject &object);
+
+	// Runs a single lockout of writes, returns true while some remain.
+	static bool WriteNext();
+
+	// Writes all pending objects, e.g. before a shutdown or a reset.
+	static void Flush();
+
+	static size_t Pending();
+
+	static Stats GetStats();
+
+	static void ScheduleWriting();
+
+private:
+	static details::StagedObject *oldestPending();
+
+	static spin_lock_t           *s_lock;
+	static details::StagedObject *s_objects;
+	static Stats                  s_stats;
+	static uint64_t               s_totalLatency_us;
+};
+
+// Saves several FlashStorage objects atomically, e.g. settings that must
+// stay consistent with each other: after a power loss the storage holds
+// either all the new values or all the previous ones. Only references are
+// kept until Commit(), which supersedes their values staged by SaveAsync().
+//
+//   FlashTransaction tx;
+//   tx.Add<StoredCalibration>(calibration);
+//   tx.Add<StoredSettings>(settings);
+//   tx.Commit();
+class FlashTransaction {
+public:
+	template <typename Storage> void Add(const typename Storage::Type &obj) {
+		static_assert(
+		    Storage::COMPRESSED == false,
+		    "compressed objects can not be saved in transactions"
+		);
+		if (d_count == PICO_NV_STORAGE_MAX_TRANSACTION) {
+			panic("FlashTransaction: too many objects");
+		}
+		d_entries[d_count] = {
+		    .UUID   = Storage::Identifier,
+		    .Object = &obj,
+		    .Size   = sizeof(obj),
+		};
+		d_staged[d_count++] = &Storage::s_staged;
+	}
+
+	// Returns false when the objects do not fit together in the storage.
+	bool Commit();
+
+private:
+	details::NVStorage::Entry d_entries[PICO_NV_STORAGE_MAX_TRANSACTION];
+	details::StagedObject    *d_staged[PICO_NV_STORAGE_MAX_TRANSACTION];
+	size_t                    d_count = 0;
+};
+
+// Stores an object of type T under UUID. PagesPerObject only bounds the size
+// of T: records are packed, and take NVStorage::SlotsFor(sizeof(T)) slots.
+//
+// Objects are stored compressed with Codec, see Compression.hpp, which saves
+// flash and erases for compressible data such as tables or histories. The
+// encoding is done before locking the other core out, into a buffer of the
+// type: a compressed type must not be used from both cores at once.
+template <
+    typename T,
+    uint16_t UUID,
+    size_t   PagesPerObject = 1,
+    typename Codec          = NoCompression>
 class FlashStorage {
-	struct Header;
+	typedef details::NVStorage::Header Header;
 
 public:
 	using Type = std::remove_cv_t<std::remove_reference_t<T>>;
 
+	static constexpr uint16_t Identifier = UUID;
+
+	static constexpr bool COMPRESSED = Codec::ID != NoCompression::ID;
+
+	// at most, incompressible data is stored as is after the codec header.
+	static constexpr size_t STORED_SIZE =
+	    sizeof(Type) + (COMPRESSED ? sizeof(details::EncodedHeader) : 0);
+
 	static constexpr size_t MAX_OBJECT_SIZE =
 	    PagesPerObject * FLASH_PAGE_SIZE - sizeof(Header);
 
@@ -47,195 +436,136 @@ public:
 	    PagesPerObject > 0, "Invalid PagesPerObject: must be strictly positive"
 	);
 	static_assert(
-	    PagesPerObject <= PAGES_PER_SECTOR,
-	    "Invalid PagesPerObject: must fit in a single sector"
+	    PagesPerObject < PAGES_PER_SECTOR,
+	    "Invalid PagesPerObject: must fit in a single sector after its "
+	    "header page"
 	);
+
 	static_assert(
-	    PAGES_PER_SECTOR % PagesPerObject == 0,
-	    "Invalid PagesPerObject: must be a divisor of number of pages in a "
-	    "sector"
+	    UUID < details::NVStorage::FIRST_RESERVED_UUID,
+	    "Invalid UUID: reserved for BlobStorage and internal records"
 	);
 
 	static_assert(
-	    sizeof(T) < MAX_OBJECT_SIZE,
+	    STORED_SIZE < MAX_OBJECT_SIZE,
 	    "Maximal Allowed Object Size exceeded, try Increase "
 	    "PagesPerObject"
 	);
 
 	inline static bool Load(T &obj) {
-		// auto saved = save_and_disable_interrupts();
-		multicore_lockout_start_blocking();
+		if constexpr (COMPRESSED) {
+			return loadEncoded(obj);
+		}
+		if (FlashStorageWriter::ReadStaged(s_staged, &obj)) {
+			return true;
+		}
+		auto &storage = mounted();
+		// Reading XIP needs no lockout. The other core only modifies the
+		// storage with this one locked out, which must not happen halfway
+		// through the read.
+		auto saved = save_and_disable_interrupts();
 		defer {
-			multicore_lockout_end_blocking();
-			// restore_interrupts_from_disabled(saved);
+			restore_interrupts(saved);
+		};
+		return storage.Load(UUID, &obj, sizeof(Type));
+	}
+
+	// Zero-copy access to the stored object, see FlashView. A value staged
+	// by SaveAsync() is only visible once written.
+	inline static details::FlashView<Type> View() {
+		static_assert(
+		    alignof(Type) <= details::NVStorage::SLOT_SIZE,
+		    "records are only aligned on slots"
+		);
+		static_assert(
+		    COMPRESSED == false,
+		    "compressed objects can only be loaded"
+		);
+		auto &storage = mounted();
+		auto  saved   = save_and_disable_interrupts();
+		defer {
+			restore_interrupts(saved);
 		};
-		return load(obj);
+		return details::FlashView<Type>(storage, UUID);
 	}
 
 	inline static bool Save(const T &obj) {
+		auto [data, size] = encode(obj);
+		// supersedes a value staged by SaveAsync().
+		FlashStorageWriter::Cancel(s_staged);
 		multicore_lockout_start_blocking();
 		defer {
 			multicore_lockout_end_blocking();
 		};
-		return save(obj);
+		return details::NVStorage::Default().Save(UUID, data, size);
 	}
 
-private:
-	static constexpr uint XIP_OFFSET =
-	    PICO_FLASH_SIZE_BYTES - PICO_NV_STORAGE_NB_SECTOR * FLASH_SECTOR_SIZE;
-	static constexpr uint8_t MAGIC_WORD = 0xaa;
-
-	struct Header {
-		const uint8_t Begin = 0xaa;
-		uint8_t       SizeInPages;
-		uint16_t      Identifier;
-	};
-
-	inline static void
-	forAllValidPages(const std::function<bool(const Header *)> &apply) {
-		for (size_t i = 0; i < PAGES_PER_SECTOR * PICO_NV_STORAGE_NB_SECTOR;) {
-			const Header *h = reinterpret_cast<const Header *>(
-			    XIP_BASE + XIP_OFFSET + i * FLASH_PAGE_SIZE
-			);
-			if (h->Begin != MAGIC_WORD) {
-				break;
-			}
-			if (apply(h) == false) {
-				break;
-			}
-			i += h->SizeInPages;
-		}
+	// Stages a copy of obj, written later by the FlashStorageWriter task.
+	// Saving again before the write replaces the staged copy, and Load()
+	// returns it meanwhile.
+	inline static void SaveAsync(const T &obj) {
+		auto [data, size] = encode(obj);
+		FlashStorageWriter::Stage(s_staged, data, size);
 	}
 
-	inline static int pageIndex(int addr) {
-		return (addr - XIP_BASE - XIP_OFFSET) / FLASH_PAGE_SIZE;
+	// true while a value staged by SaveAsync() is not written yet.
+	inline static bool Pending() {
+		return s_staged.Pending;
 	}
 
-	inline static bool load(T &obj) {
-		debugf("[FlashStorage]: Identifier=%08x\n");
-		const Type *valid = nullptr;
-		forAllValidPages([&valid](const Header *h) {
-			if (h->Identifier == UUID && h->SizeInPages == PagesPerObject) {
-				valid = reinterpret_cast<const Type *>(
-				    reinterpret_cast<const uint8_t *>(h) + sizeof(Header)
-				);
-			}
-			return true;
-		});
-
-		if (valid == nullptr) {
-			debugf("[FlashStorage]: No Pages found\n", UUID);
-			return false;
-		}
-		debugf(
-		    "[FlashStorage]: Pages %d matches\n",
-		    pageIndex(int(valid) - sizeof(Header))
-		);
-		obj = *valid;
-		return true;
-	}
-
-	inline static size_t findFree() {
-		for (size_t i = 0; i < PAGES_PER_SECTOR * PICO_NV_STORAGE_NB_SECTOR;) {
-			const Header *h = reinterpret_cast<const Header *>(
-			    XIP_BASE + XIP_OFFSET + i * FLASH_PAGE_SIZE
-			);
-			if (h->Begin == MAGIC_WORD) {
-				i += h->SizeInPages;
-				continue;
-			}
-			debugf("[FlashStorage]: page %d is free\n", i);
-			return i;
+private:
+	friend class FlashTransaction;
+
+	inline static details::NVStorage &mounted() {
+		auto &storage = details::NVStorage::Default();
+		if (storage.Mounted() == false) {
+			// mounting may finish an interrupted compaction.
+			multicore_lockout_start_blocking();
+			storage.Mount();
+			multicore_lockout_end_blocking();
 		}
-		debugf("[FlashStorage]: no page is free\n");
-		return PAGES_PER_SECTOR * PICO_NV_STORAGE_NB_SECTOR;
+		return storage;
 	}
 
-	inline static bool save(const T &obj) {
-		debugf("[FlashStorage]: storing object UUID=%d\n", UUID);
-		if (isSame(obj)) {
-			debugf("[FlashStorage]: not saving as it is unchanged\n");
-			return false;
+	// The bytes to store for obj, and their size.
+	inline static std::pair<const void *, size_t> encode(const Type &obj) {
+		if constexpr (COMPRESSED) {
+			return {
+			    s_encoded,
+			    details::Encode(
+			        Codec::Encode,
+			        Codec::ID,
+			        &obj,
+			        sizeof(Type),
+			        s_encoded
+			    ),
+			};
 		}
-
-		size_t idx = findFree();
-
-		if (idx == PAGES_PER_SECTOR * PICO_NV_STORAGE_NB_SECTOR) {
-			idx = erase();
-		}
-
-		uint8_t buffer[PagesPerObject * FLASH_PAGE_SIZE];
-		Header  h = {
-		     .SizeInPages = PagesPerObject,
-		     .Identifier  = UUID,
-        };
-
-		memcpy(buffer, &h, sizeof(Header));
-		memcpy(buffer + sizeof(Header), &obj, sizeof(Type));
-		memset(
-		    buffer + sizeof(Header) + sizeof(Type),
-		    0x00,
-		    PagesPerObject * FLASH_PAGE_SIZE - sizeof(Header) - sizeof(Type)
-		);
-
-		flash_range_program(
-		    XIP_OFFSET + idx * FLASH_PAGE_SIZE,
-		    buffer,
-		    PagesPerObject * FLASH_PAGE_SIZE
-		);
-
-		debugf("[FlashStorage]: saved at page %d\n", idx);
-		return true;
+		return {&obj, sizeof(Type)};
 	}
 
-	inline static int erase() {
-		debugf("[FlashStorage]: erasing page\n");
-
-		// We need to save all values that will not be affected
-		std::map<uint16_t, std::vector<uint8_t>> saved;
-		forAllValidPages([&](const Header *h) {
-			if (h->Identifier == UUID) {
-				return true;
+	inline static bool loadEncoded(T &obj) {
+		size_t size;
+		if (FlashStorageWriter::ReadStaged(s_staged, s_encoded)) {
+			size = s_staged.Size;
+		} else {
+			auto &storage = mounted();
+			auto  saved   = save_and_disable_interrupts();
+			auto  stored  = storage.Read(UUID, s_encoded, STORED_SIZE);
+			restore_interrupts(saved);
+			if (stored.has_value() == false || stored.value() > STORED_SIZE) {
+				return false;
 			}
-			debugf("[FlashStorage]: Saving UUID=%d\n", h->Identifier);
-			saved[h->Identifier].resize(h->SizeInPages * FLASH_PAGE_SIZE);
-			memcpy(
-			    saved[h->Identifier].data(),
-			    reinterpret_cast<const uint8_t *>(h),
-			    h->SizeInPages * FLASH_PAGE_SIZE
-			);
-			return true;
-		});
-		flash_range_erase(
-		    XIP_OFFSET,
-		    PICO_NV_STORAGE_NB_SECTOR * FLASH_SECTOR_SIZE
-		);
-		size_t i = 0;
-		for (const auto &[_, data] : saved) {
-			auto header = reinterpret_cast<const Header *>(data.data());
-			debugf(
-			    "[FlashStorage]: Programming UUID=%d at page %d size:%d\n",
-			    header->Identifier,
-			    i / FLASH_PAGE_SIZE,
-			    data.size()
-			);
-
-			flash_range_program(XIP_OFFSET + i, data.data(), data.size());
-			debugf(
-			    "[FlashStorage]: done programming UUID=%d.\n",
-			    header->Identifier
-			);
-			i += data.size();
+			size = stored.value();
 		}
-		debugf("[FlashStorage]: next free page is %d\n", i / FLASH_PAGE_SIZE);
-		return i / FLASH_PAGE_SIZE;
+		return details::Decode(s_encoded, size, &obj, sizeof(Type));
 	}
 
-	inline static bool isSame(const T &obj) {
-		Type saved;
-		if (!load(saved)) {
-			return false;
-		}
-		return memcmp(&saved, &obj, sizeof(Type)) == 0;
-	}
+	alignas(Type) static inline uint8_t s_buffer[STORED_SIZE];
+	static inline uint8_t s_encoded[COMPRESSED ? STORED_SIZE : 1];
+	static inline details::StagedObject s_staged = {
+	    .UUID = UUID,
+	    .Size = STORED_SIZE,
+	    .Data = s_buffer,
+	};
 };
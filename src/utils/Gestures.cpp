@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "Gestures.hpp"
+
+#include <algorithm>
+
+#include <pico/platform/panic.h>
+#include <pico/time.h>
+
+namespace details {
+
+// actions of the transitions. MARK_PRESS starts the repeats and holds over,
+// COUNT_HELD counts a press held down after clicks as one more, FLUSH_CLICKS
+// reports the clicks counted so far, and TICK the repeats and holds due.
+static constexpr uint8_t MARK_PRESS      = 1 << 0;
+static constexpr uint8_t COUNT_CLICK     = 1 << 1;
+static constexpr uint8_t COUNT_HELD      = 1 << 2;
+static constexpr uint8_t FLUSH_CLICKS    = 1 << 3;
+static constexpr uint8_t EMIT_PRESS_DOWN = 1 << 4;
+static constexpr uint8_t EMIT_RELEASE    = 1 << 5;
+static constexpr uint8_t TICK            = 1 << 6;
+
+typedef GestureState::Phase Phase;
+
+// indexed by the current state and the trigger. The timeouts are the long
+// press when PRESSED, the end of the clicks when COUNTING, and the next
+// repeat or hold when HELD.
+const GestureMachine::Transition GestureMachine::TRANSITIONS[4][3] = {
+    // IDLE
+    {
+        {.Next = Phase::PRESSED, .Actions = MARK_PRESS},
+        {.Next = Phase::IDLE, .Actions = 0},
+        {.Next = Phase::IDLE, .Actions = 0},
+    },
+    // PRESSED
+    {
+        {.Next = Phase::PRESSED, .Actions = 0},
+        {.Next = Phase::COUNTING, .Actions = COUNT_CLICK},
+        {
+            .Next    = Phase::HELD,
+            .Actions = COUNT_HELD | FLUSH_CLICKS | EMIT_PRESS_DOWN,
+        },
+    },
+    // COUNTING
+    {
+        {.Next = Phase::PRESSED, .Actions = MARK_PRESS},
+        {.Next = Phase::COUNTING, .Actions = 0},
+        {.Next = Phase::IDLE, .Actions = FLUSH_CLICKS},
+    },
+    // HELD
+    {
+        {.Next = Phase::HELD, .Actions = 0},
+        {.Next = Phase::IDLE, .Actions = EMIT_RELEASE},
+        {.Next = Phase::HELD, .Actions = TICK},
+    },
+};
+
+void GestureMachine::AddChord(uint32_t buttons) {
+	for (auto &c : d_chords) {
+		if (c == 0) {
+			c = buttons;
+			return;
+		}
+	}
+	panic("[GestureMachine]: more than PICO_GESTURE_MAX_CHORDS");
+}
+
+absolute_time_t GestureMachine::NextDeadline() const {
+	return d_timeouts != 0 ? d_nextDeadline : at_the_end_of_time;
+}
+
+void GestureMachine::emit(
+    Gesture type, uint button, uint count, uint32_t buttons
+) {
+	onGesture(GestureEvent{
+	    .Type    = type,
+	    .Button  = uint8_t(button),
+	    .Count   = uint16_t(count),
+	    .Buttons = buttons == 0 ? 1U << button : buttons,
+	});
+}
+
+void GestureMachine::Step(
+    uint32_t changed, uint32_t levels, absolute_time_t now
+) {
+	// the buttons of a chord are ignored until released.
+	d_captured &= levels;
+	changed &= ~d_captured;
+
+	// the state machines only run for the toggled buttons, and the ones
+	// whose timeout expired.
+	uint32_t buttons = changed;
+	if (d_timeouts != 0 && now >= d_nextDeadline) {
+		buttons |= d_timeouts;
+	}
+	if (buttons == 0) {
+		return;
+	}
+	uint32_t processed = buttons | d_timeouts;
+	for (; buttons != 0; buttons &= buttons - 1) {
+		uint     b   = __builtin_ctz(buttons);
+		uint32_t bit = 1U << b;
+		// timeouts expired before now happen at the time they expire.
+		for (auto d = deadline(b); d <= now; d = deadline(b)) {
+			step(b, Trigger::TIMEOUT, d);
+		}
+		if (changed & bit) {
+			step(b, levels & bit ? Trigger::PRESS : Trigger::RELEASE, now);
+		}
+	}
+	if ((changed & levels) != 0) {
+		chords(levels, now);
+	}
+
+	d_timeouts     = 0;
+	d_nextDeadline = at_the_end_of_time;
+	for (uint32_t m = processed; m != 0; m &= m - 1) {
+		uint b = __builtin_ctz(m);
+		auto d = deadline(b);
+		if (d != at_the_end_of_time) {
+			d_timeouts |= 1U << b;
+			d_nextDeadline = std::min(d_nextDeadline, d);
+		}
+	}
+}
+
+void GestureMachine::step(uint button, Trigger trigger, absolute_time_t at) {
+	auto &s = d_states[button];
+	auto  t = TRANSITIONS[int(s.Current)][int(trigger)];
+
+	if (t.Actions & MARK_PRESS) {
+		s.Pressed = at;
+		s.Holds   = 0;
+		s.Repeats = 0;
+		s.RepeatPeriod_us = std::max<uint32_t>(
+		    d_config.RepeatPeriod_us,
+		    PICO_GESTURE_MIN_REPEAT_PERIOD_US
+		);
+		s.NextRepeat      = at + d_config.RepeatDelay_us;
+	}
+	if (t.Actions & COUNT_CLICK) {
+		s.Clicks = std::min<uint>(d_config.MaxClicks, s.Clicks + 1);
+	}
+	if ((t.Actions & COUNT_HELD) && s.Clicks > 0) {
+		s.Clicks = std::min<uint>(d_config.MaxClicks, s.Clicks + 1);
+	}
+	if ((t.Actions & FLUSH_CLICKS) && s.Clicks > 0) {
+		emit(Gesture::CLICKS, button, s.Clicks);
+		s.Clicks = 0;
+	}
+	if (t.Actions & EMIT_PRESS_DOWN) {
+		emit(Gesture::PRESS_DOWN, button, 0);
+	}
+	if (t.Actions & EMIT_RELEASE) {
+		emit(Gesture::RELEASE, button, 0);
+	}
+	if (t.Actions & TICK) {
+		tick(button, at);
+	}
+	if (t.Next != s.Current) {
+		s.Current    = t.Next;
+		s.Transition = at;
+	}
+}
+
+void GestureMachine::tick(uint button, absolute_time_t at) {
+	auto &s = d_states[button];
+	if (d_config.RepeatDelay_us > 0 && at >= s.NextRepeat) {
+		emit(Gesture::REPEAT, button, ++s.Repeats);
+		s.NextRepeat += s.RepeatPeriod_us;
+		uint64_t next = uint64_t(s.RepeatPeriod_us) *
+		                d_config.RepeatAcceleration / 256;
+		s.RepeatPeriod_us = std::clamp<uint64_t>(
+		    next,
+		    std::max<uint32_t>(
+		        d_config.RepeatMinPeriod_us,
+		        PICO_GESTURE_MIN_REPEAT_PERIOD_US
+		    ),
+		    UINT32_MAX
+		);
+	}
+	if (at >= nextHold(s)) {
+		emit(Gesture::HOLD, button, s.Holds);
+		++s.Holds;
+	}
+}
+
+absolute_time_t GestureMachine::nextHold(const GestureState &s) const {
+	if (s.Holds >= PICO_GESTURE_MAX_HOLDS || d_config.Holds_ms[s.Holds] == 0) {
+		return at_the_end_of_time;
+	}
+	return s.Pressed + d_config.Holds_ms[s.Holds] * 1000ULL;
+}
+
+absolute_time_t GestureMachine::deadline(uint button) const {
+	// the state machine moves once strictly more than the period elapsed.
+	const auto &s = d_states[button];
+	switch (s.Current) {
+	case Phase::PRESSED:
+		return s.Transition + d_config.LongPress_us + 1;
+	case Phase::COUNTING:
+		return s.Transition + d_config.MultipleClickMaxPeriod_us + 1;
+	case Phase::HELD: {
+		absolute_time_t res = at_the_end_of_time;
+		if (d_config.RepeatDelay_us > 0) {
+			res = s.NextRepeat;
+		}
+		return std::min(res, nextHold(s));
+	}
+	default:
+		return at_the_end_of_time;
+	}
+}
+
+void GestureMachine::chords(uint32_t pressed, absolute_time_t now) {
+	for (uint i = 0; i < d_chords.size(); ++i) {
+		uint32_t c = d_chords[i];
+		if (c == 0 || (pressed & c) != c || (d_captured & c) != 0) {
+			continue;
+		}
+		absolute_time_t first = now;
+		for (uint32_t m = c; m != 0; m &= m - 1) {
+			first = std::min(first, d_states[__builtin_ctz(m)].Pressed);
+		}
+		if (absolute_time_diff_us(first, now) > d_config.ChordWindow_us) {
+			continue;
+		}
+		// the clicks before are kept, the presses of the chord are not
+		// gestures of their own.
+		for (uint32_t m = c; m != 0; m &= m - 1) {
+			uint  b = __builtin_ctz(m);
+			auto &s = d_states[b];
+			if (s.Clicks > 0) {
+				emit(Gesture::CLICKS, b, s.Clicks);
+			}
+			s = {};
+		}
+		d_captured |= c;
+		emit(Gesture::CHORD, __builtin_ctz(c), i, c);
+	}
+}
+
+} // namespace details
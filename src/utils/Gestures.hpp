@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: LGPL-3.0+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <pico/types.h>
+
+// Maximal number of hold thresholds and chords of a GestureMachine.
+#ifndef PICO_GESTURE_MAX_HOLDS
+#define PICO_GESTURE_MAX_HOLDS 3
+#endif
+
+#ifndef PICO_GESTURE_MAX_CHORDS
+#define PICO_GESTURE_MAX_CHORDS 4
+#endif
+
+// Shortest repeat period, whatever the configuration, so a button held down
+// repeats at most once per sample of a ButtonBank.
+#ifndef PICO_GESTURE_MIN_REPEAT_PERIOD_US
+#define PICO_GESTURE_MIN_REPEAT_PERIOD_US 5000
+#endif
+
+enum class Gesture : uint8_t {
+	// Count clicks, up to MaxClicks, followed by a pause, or by a press held
+	// down, which counts as one more.
+	CLICKS,
+	// held down for LongPress_us.
+	PRESS_DOWN,
+	// released after a PRESS_DOWN.
+	RELEASE,
+	// the Count-th repeat while held down.
+	REPEAT,
+	// held down for Holds_ms[Count].
+	HOLD,
+	// the Buttons of the Count-th chord pressed together.
+	CHORD,
+};
+
+struct GestureEvent {
+	Gesture Type;
+	// the button, the first one for a chord.
+	uint8_t  Button;
+	uint16_t Count;
+	uint32_t Buttons;
+};
+
+// Timings of the gestures. Engines can be given constexpr configurations, or
+// built ones.
+struct GestureConfig {
+	uint32_t MultipleClickMaxPeriod_us = 300 * 1000;
+	uint32_t LongPress_us              = 250 * 1000;
+	uint8_t  MaxClicks                 = 3;
+	// repeats start while held down after RepeatDelay_us, or never when 0.
+	// Each period is the previous one times RepeatAcceleration / 256, down to
+	// RepeatMinPeriod_us, and never below PICO_GESTURE_MIN_REPEAT_PERIOD_US.
+	uint32_t RepeatDelay_us     = 500 * 1000;
+	uint32_t RepeatPeriod_us    = 200 * 1000;
+	uint32_t RepeatMinPeriod_us = 40 * 1000;
+	uint16_t RepeatAcceleration = 205;
+	// increasing durations, 0 when unused.
+	uint32_t Holds_ms[PICO_GESTURE_MAX_HOLDS] = {1000, 3000};
+	// the buttons of a chord are pressed within this time.
+	uint32_t ChordWindow_us = 50 * 1000;
+};
+
+namespace details {
+struct GestureState {
+	enum class Phase : uint8_t {
+		IDLE,
+		PRESSED,
+		// released, more clicks may follow.
+		COUNTING,
+		HELD,
+	};
+
+	Phase           Current         = Phase::IDLE;
+	uint8_t         Clicks          = 0;
+	uint8_t         Holds           = 0;
+	uint16_t        Repeats         = 0;
+	uint32_t        RepeatPeriod_us = 0;
+	absolute_time_t Transition      = 0;
+	absolute_time_t Pressed         = 0;
+	absolute_time_t NextRepeat      = 0;
+};
+
+// States of N buttons. Users of GestureMachine derive from it first, so the
+// states are built before the machine.
+template <size_t N> struct GestureStates {
+	GestureState States[N];
+};
+
+// Recognizes gestures on up to 32 buttons from their debounced levels, with
+// a state machine per button driven by a transition table. Button,
+// ButtonBank and ButtonGestures are built on it, and get the gestures in
+// onGesture().
+class GestureMachine {
+public:
+	// The buttons pressed together give a CHORD instead of their own
+	// gestures, until they are all released.
+	void AddChord(uint32_t buttons);
+
+	// Steps the state machines of the buttons that changed to the given
+	// levels, a bit set for each pressed one, and of the buttons whose
+	// timeout expired before now.
+	void Step(uint32_t changed, uint32_t levels, absolute_time_t now);
+
+	// Earliest timeout of the buttons, or at_the_end_of_time.
+	absolute_time_t NextDeadline() const;
+
+protected:
+	GestureMachine(GestureState *states, const GestureConfig &config)
+	    : d_states{states}
+	    , d_config{config} {}
+	virtual ~GestureMachine() = default;
+
+	// the states belong to the derived class.
+	GestureMachine(const GestureMachine &)            = delete;
+	GestureMachine(GestureMachine &&)                 = delete;
+	GestureMachine &operator=(const GestureMachine &) = delete;
+	GestureMachine &operator=(GestureMachine &&)      = delete;
+
+	// Gestures of the button of the given index.
+	virtual void onGesture(const GestureEvent &e) = 0;
+
+private:
+	enum class Trigger : uint8_t {
+		PRESS,
+		RELEASE,
+		TIMEOUT,
+	};
+
+	struct Transition {
+		GestureState::Phase Next;
+		uint8_t             Actions;
+	};
+
+	static const Transition TRANSITIONS[4][3];
+
+	void step(uint button, Trigger trigger, absolute_time_t at);
+	void tick(uint button, absolute_time_t at);
+	void chords(uint32_t pressed, absolute_time_t now);
+	void emit(Gesture type, uint button, uint count, uint32_t buttons = 0);
+
+	absolute_time_t deadline(uint button) const;
+	absolute_time_t nextHold(const GestureState &s) const;
+
+	GestureState *d_states;
+	GestureConfig d_config;
+
+	// buttons waiting for a timeout, and the first one.
+	uint32_t        d_timeouts     = 0;
+	absolute_time_t d_nextDeadline = 0;
+	// buttons of the chords pressed, until they are released.
+	uint32_t d_captured = 0;
+
+	std::array<uint32_t, PICO_GESTURE_MAX_CHORDS> d_chords{};
+};
+} // namespace details
@@ -0,0 +1,193 @@
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "KeyMatrix.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+#include <hardware/dma.h>
+#include <hardware/gpio.h>
+#include <hardware/pio.h>
+#include <pico/platform/panic.h>
+#include <pico/time.h>
+
+#include <utils/Scheduler.hpp>
+
+// For each row r, with shifts to the right and autopush after a scan:
+//     set pindirs, 1 << r [SETTLE_CYCLES - 1]
+//     in  pins, nbColumns
+static constexpr uint KEY_MATRIX_SETTLE_CYCLES = 32;
+static constexpr uint KEY_MATRIX_ROW_CYCLES    = KEY_MATRIX_SETTLE_CYCLES + 1;
+
+// a transfer lasts 49 days at 1kHz, it is restarted halfway.
+static constexpr uint32_t KEY_MATRIX_TRANSFER = ~0U;
+static constexpr uint32_t KEY_MATRIX_RESTART  = 1U << 31;
+
+namespace details {
+uint KeyMatrixProgram(uint nbRows, uint nbColumns, uint16_t *out) {
+	constexpr uint16_t SET_PINDIRS = 0xe080;
+	constexpr uint16_t IN_PINS     = 0x4000;
+
+	for (uint r = 0; r < nbRows; ++r) {
+		*out++ = SET_PINDIRS | (KEY_MATRIX_SETTLE_CYCLES - 1) << 8 | 1 << r;
+		*out++ = IN_PINS | (nbColumns & 0x1f);
+	}
+	return 2 * nbRows;
+}
+
+uint32_t RemoveGhosts(
+    uint32_t keys, uint32_t previous, uint nbRows, uint nbColumns
+) {
+	uint32_t row       = nbColumns < 32 ? (1U << nbColumns) - 1 : ~0U;
+	uint32_t ambiguous = 0;
+	for (uint i = 0; i < nbRows; ++i) {
+		uint32_t a = (keys >> (i * nbColumns)) & row;
+		for (uint j = i + 1; j < nbRows; ++j) {
+			uint32_t b = (keys >> (j * nbColumns)) & row;
+			if (__builtin_popcount(a & b) >= 2) {
+				ambiguous |= row << (i * nbColumns) | row << (j * nbColumns);
+			}
+		}
+	}
+	return (keys & ~ambiguous) | (keys & previous & ambiguous);
+}
+} // namespace details
+
+std::vector<KeyMatrix *> &KeyMatrix::matrices() {
+	static std::vector<KeyMatrix *> s_matrices;
+	return s_matrices;
+}
+
+KeyMatrix::KeyMatrix(
+    uint firstRow, uint nbRows, uint firstColumn, uint nbColumns, PIO pio
+)
+    : d_nbRows{nbRows}
+    , d_nbColumns{nbColumns}
+    , d_pio{pio}
+    , d_bank{
+          nbRows * nbColumns == 32 ? ~0U : (1U << (nbRows * nbColumns)) - 1,
+          ButtonBank::Input::EXTERNAL
+      } {
+	if (nbRows == 0 || nbRows > MAX_ROWS || nbColumns == 0 ||
+	    nbRows * nbColumns > MAX_KEYS) {
+		panic("[KeyMatrix]: more than 5 rows or 32 keys");
+	}
+
+	uint nbKeys = nbRows * nbColumns;
+	uint length = details::KeyMatrixProgram(nbRows, nbColumns, d_instructions);
+
+	d_program = {
+	    .instructions = d_instructions,
+	    .length       = uint8_t(length),
+	    .origin       = -1,
+	};
+	d_sm      = pio_claim_unused_sm(pio, true);
+	d_channel = dma_claim_unused_channel(true);
+	d_offset  = pio_add_program(pio, &d_program);
+
+	auto config = pio_get_default_sm_config();
+	sm_config_set_wrap(&config, d_offset, d_offset + d_program.length - 1);
+	sm_config_set_set_pins(&config, firstRow, nbRows);
+	sm_config_set_in_pins(&config, firstColumn);
+	// the first row ends in the lowest bits of the scan.
+	sm_config_set_in_shift(&config, true, true, nbKeys);
+	sm_config_set_fifo_join(&config, PIO_FIFO_JOIN_RX);
+	sm_config_set_clkdiv(
+	    &config,
+	    float(SYS_CLK_HZ) /
+	        (PICO_KEY_MATRIX_SCAN_RATE_HZ * nbRows * KEY_MATRIX_ROW_CYCLES)
+	);
+
+	// the rows only drive low, and float when not scanned, so pressing keys
+	// never shorts two rows. pio_gpio_init() keeps the pull-downs of the
+	// pads, which would pull the columns of the keys held down mid-rail.
+	uint32_t rows = ((1U << nbRows) - 1) << firstRow;
+	for (uint i = 0; i < nbRows; ++i) {
+		pio_gpio_init(pio, firstRow + i);
+		gpio_disable_pulls(firstRow + i);
+	}
+	pio_sm_set_pins_with_mask(pio, d_sm, 0, rows);
+	pio_sm_set_pindirs_with_mask(pio, d_sm, 0, rows);
+	for (uint i = 0; i < nbColumns; ++i) {
+		gpio_init(firstColumn + i);
+		gpio_pull_up(firstColumn + i);
+	}
+	pio_sm_init(pio, d_sm, d_offset, &config);
+
+	// released until the first scan.
+	std::fill(std::begin(d_scans), std::end(d_scans), ~0U);
+	auto dma = dma_channel_get_default_config(d_channel);
+	channel_config_set_transfer_data_size(&dma, DMA_SIZE_32);
+	channel_config_set_read_increment(&dma, false);
+	channel_config_set_write_increment(&dma, true);
+	channel_config_set_ring(&dma, true, RING_SIZE_BITS);
+	channel_config_set_dreq(&dma, pio_get_dreq(pio, d_sm, false));
+	dma_channel_configure(
+	    d_channel,
+	    &dma,
+	    d_scans,
+	    &pio->rxf[d_sm],
+	    KEY_MATRIX_TRANSFER,
+	    true
+	);
+	pio_sm_set_enabled(pio, d_sm, true);
+
+	matrices().push_back(this);
+}
+
+KeyMatrix::~KeyMatrix() {
+	auto &m = matrices();
+	m.erase(std::remove(m.begin(), m.end(), this), m.end());
+
+	pio_sm_set_enabled(d_pio, d_sm, false);
+	dma_channel_abort(d_channel);
+	dma_channel_unclaim(d_channel);
+	pio_remove_program(d_pio, &d_program, d_offset);
+	pio_sm_unclaim(d_pio, d_sm);
+}
+
+uint64_t KeyMatrix::Scans() const {
+	return d_scanned + KEY_MATRIX_TRANSFER -
+	       dma_channel_hw_addr(d_channel)->transfer_count;
+}
+
+void KeyMatrix::ScheduleUpdateTask() {
+	Scheduler::Get().Schedule(
+	    ButtonBank::SAMPLE_PERIOD_us,
+	    updateAllTask,
+	    {.Start = 0, .Name = "keys"}
+	);
+}
+
+std::optional<int64_t> KeyMatrix::updateAllTask(absolute_time_t now) {
+	for (const auto self : matrices()) {
+		self->update(now);
+	}
+	return std::nullopt;
+}
+
+void KeyMatrix::update(absolute_time_t now) {
+	uint64_t start = time_us_64();
+
+	auto hw = dma_channel_hw_addr(d_channel);
+	if (hw->transfer_count < KEY_MATRIX_RESTART) {
+		// the ring goes on from the address the transfer stopped at.
+		dma_channel_abort(d_channel);
+		d_scanned += KEY_MATRIX_TRANSFER - hw->transfer_count;
+		dma_channel_set_trans_count(d_channel, KEY_MATRIX_TRANSFER, true);
+	}
+
+	// the slot before the next one written holds the last complete scan.
+	uint next = (hw->write_addr - uintptr_t(d_scans)) / sizeof(uint32_t);
+	uint last = (next + std::size(d_scans) - 1) % std::size(d_scans);
+
+	// the scan fills the word from its most significant bit, and the keys
+	// read low when pressed.
+	uint     nbKeys = d_nbRows * d_nbColumns;
+	uint32_t keys   = ~d_scans[last] >> (32 - nbKeys);
+	d_keys = details::RemoveGhosts(keys, d_keys, d_nbRows, d_nbColumns);
+	d_bank.Process(d_keys, now);
+
+	d_busy_us += time_us_64() - start;
+	++d_updates;
+}
@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: LGPL-3.0+
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <hardware/pio.h>
+#include <pico/types.h>
+
+#include <utils/ButtonBank.hpp>
+
+// Scans of all the keys per second done by the PIO.
+#ifndef PICO_KEY_MATRIX_SCAN_RATE_HZ
+#define PICO_KEY_MATRIX_SCAN_RATE_HZ 1000
+#endif
+
+// Keys at the crossings of rows and columns, scanned by a PIO state machine
+// into a ring buffer by DMA, so scanning costs no CPU. The update task
+// debounces and classifies the last scan like a ButtonBank.
+class KeyMatrix {
+public:
+	// the rows are driven by SET instructions, and a scan fits a word.
+	static constexpr uint MAX_ROWS = 5;
+	static constexpr uint MAX_KEYS = 32;
+
+	// Rows and columns are on consecutive GPIOs. Rows are driven low one at
+	// a time, the others left floating, and the columns have a pull-up.
+	KeyMatrix(
+	    uint firstRow,
+	    uint nbRows,
+	    uint firstColumn,
+	    uint nbColumns,
+	    PIO  pio = pio0
+	);
+	~KeyMatrix();
+
+	KeyMatrix(const KeyMatrix &)            = delete;
+	KeyMatrix(KeyMatrix &&)                 = delete;
+	KeyMatrix &operator=(const KeyMatrix &) = delete;
+	KeyMatrix &operator=(KeyMatrix &&)      = delete;
+
+	// Events of key row * nbColumns + column.
+	std::optional<ButtonBank::PinEvent> Pending() {
+		return d_bank.Pending();
+	}
+
+	// Debounced level of the keys, a bit set for each pressed one.
+	uint32_t Pressed() const {
+		return d_bank.Pressed();
+	}
+
+	// Scans done by the PIO since the construction.
+	uint64_t Scans() const;
+
+	// CPU time spent by the update task on this matrix, and its number of
+	// runs.
+	uint64_t Busy_us() const {
+		return d_busy_us;
+	}
+
+	uint32_t Updates() const {
+		return d_updates;
+	}
+
+	// Processes the scans every ButtonBank::SAMPLE_PERIOD_us.
+	static void ScheduleUpdateTask();
+
+private:
+	static std::optional<int64_t> updateAllTask(absolute_time_t now);
+
+	void update(absolute_time_t now);
+
+	static std::vector<KeyMatrix *> &matrices();
+
+	uint d_nbRows;
+	uint d_nbColumns;
+
+	PIO           d_pio;
+	uint          d_sm;
+	int           d_channel;
+	uint16_t      d_instructions[2 * MAX_ROWS];
+	pio_program_t d_program;
+	uint          d_offset;
+
+	// written by the DMA, the PIO pushes a word per scan.
+	static constexpr uint RING_SIZE_BITS = 5;
+	alignas(1 << RING_SIZE_BITS) uint32_t d_scans[8];
+	// scans of the previous DMA transfers.
+	uint64_t d_scanned = 0;
+
+	ButtonBank d_bank;
+	// last scan processed, without ghosts.
+	uint32_t d_keys    = 0;
+	uint64_t d_busy_us = 0;
+	uint32_t d_updates = 0;
+};
+
+namespace details {
+// Program scanning the rows one after the other, each one waiting for the
+// columns to settle before sampling them. Returns its number of instructions.
+uint KeyMatrixProgram(uint nbRows, uint nbColumns, uint16_t *out);
+
+// Without diodes, 3 pressed keys at the corners of a rectangle also make the
+// fourth one read as pressed. Keys newly pressed are ignored in the rows
+// sharing 2 or more pressed columns, until they do not.
+uint32_t RemoveGhosts(
+    uint32_t keys, uint32_t previous, uint nbRows, uint nbColumns
+);
+} // namespace details
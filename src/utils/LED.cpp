@@ -4,38 +4,127 @@
 #include <cstdint>
 #include <optional>
 
+#include <hardware/dma.h>
 #include <hardware/gpio.h>
 #include <hardware/pwm.h>
+#include <hardware/sync.h>
+#include <pico/platform/panic.h>
 #include <pico/time.h>
 #include <pico/types.h>
 
 #include <utils/Log.hpp>
 #include <utils/Scheduler.hpp>
 
-std::vector<LED *> &LED::leds() {
-	static std::vector<LED *> s_leds;
-	return s_leds;
+BlockingQueue<LED::ConfigUpdate, 8> LED::s_updates;
+
+static constexpr uint32_t PWM_TOP = (1U << PICO_LED_PWM_BITS) - 1;
+static_assert(
+    PICO_LED_PWM_BITS >= 12 && PICO_LED_PWM_BITS <= 16,
+    "PICO_LED_PWM_BITS must be between 12 and 16"
+);
+
+// the closest 8.4 fixed point clock divider.
+static constexpr uint64_t PWM_FRAME_CYCLES =
+    uint64_t(PICO_LED_PWM_FREQUENCY_HZ) * (PWM_TOP + 1);
+static constexpr uint64_t PWM_DIVIDER =
+    (uint64_t(SYS_CLK_HZ) * 16 + PWM_FRAME_CYCLES / 2) / PWM_FRAME_CYCLES;
+static_assert(
+    PWM_DIVIDER >= 16 && PWM_DIVIDER < 256 * 16,
+    "PICO_LED_PWM_FREQUENCY_HZ can not be reached with PICO_LED_PWM_BITS"
+);
+
+static constexpr auto GAMMA = details::MakeLEDGamma(PWM_TOP);
+static_assert(GAMMA[0] == 0 && GAMMA[255] == PWM_TOP);
+
+static uint16_t luminance(uint32_t level) {
+	return details::LEDLuminance(GAMMA, level);
 }
 
-BlockingQueue<LED::ConfigUpdate, 8> LED::s_updates;
+static constexpr size_t WAVEFORM_STEPS = PICO_LED_WAVEFORM_STEPS;
+static_assert(
+    WAVEFORM_STEPS > 1 && (WAVEFORM_STEPS & (WAVEFORM_STEPS - 1)) == 0,
+    "PICO_LED_WAVEFORM_STEPS must be a power of two"
+);
 
-LED::LED(uint pin)
-    : d_slice{pwm_gpio_to_slice_num(pin)}
-    , d_channel{pwm_gpio_to_channel(pin)} {
+// The data channel writes the compare register of the slice a few times per
+// step, paced by a DMA timer, from the level of the current step, then
+// chains to the control channel. The control channel restarts it on the
+// level of the next step, wrapping around Steps, so the waveform loops
+// without the CPU. The PWM latches the level at its next wrap.
+struct LED::Waveform {
+	alignas(WAVEFORM_STEPS * sizeof(uint32_t *))
+	    const uint32_t *Steps[WAVEFORM_STEPS];
+	// both channels of the slice.
+	uint32_t Levels[WAVEFORM_STEPS];
+	int      Control = -1, Data = -1, Timer = -1;
+	bool     Used    = false;
+};
+
+LED::Waveform LED::s_waveforms[PICO_LED_MAX_WAVEFORMS];
+
+class LED::State {
+public:
+	void work(absolute_time_t now);
+
+	void setConfig(const Config &);
+
+	void performBlink(absolute_time_t now);
+	void performPulse(absolute_time_t now);
+	void performAnimation(absolute_time_t now);
+
+	State *partner();
+	bool   startWaveform();
+	void   stopWaveform();
 
+	bool      d_used = false;
+	uint      d_slice, d_channel;
+	Config    d_config;
+	Waveform *d_waveform = nullptr;
+
+	details::LEDAnimator d_animator;
+	// perceived level in 8.8 fixed point, where animations start from.
+	uint16_t        d_level = 0;
+	absolute_time_t d_lastUpdate;
+};
+
+LED::State LED::s_states[PICO_LED_MAX_LEDS];
+
+static pwm_config ledConfig() {
 	auto config = pwm_get_default_config();
-	pwm_config_set_clkdiv(&config, float(SYS_CLK_HZ) / 255 * 1000.0f);
-	pwm_config_set_wrap(&config, 255 - 1);
-	gpio_set_function(pin, GPIO_FUNC_PWM);
-	pwm_set_chan_level(d_slice, d_channel, 0);
-	pwm_init(d_slice, &config, true);
+	pwm_config_set_clkdiv_int_frac(
+	    &config,
+	    PWM_DIVIDER >> 4,
+	    PWM_DIVIDER & 0xf
+	);
+	pwm_config_set_wrap(&config, PWM_TOP);
+	return config;
+}
 
-	leds().push_back(this);
+LED::LED(uint pin)
+    : d_state{nullptr} {
+	for (auto &state : s_states) {
+		if (state.d_used == false) {
+			d_state = &state;
+			break;
+		}
+	}
+	if (d_state == nullptr) {
+		panic("[LED]: more than PICO_LED_MAX_LEDS LEDs");
+	}
+	*d_state           = State{};
+	d_state->d_slice   = pwm_gpio_to_slice_num(pin);
+	d_state->d_channel = pwm_gpio_to_channel(pin);
+
+	auto config = ledConfig();
+	gpio_set_function(pin, GPIO_FUNC_PWM);
+	pwm_set_chan_level(d_state->d_slice, d_state->d_channel, 0);
+	pwm_init(d_state->d_slice, &config, true);
+	d_state->d_used = true;
 }
 
 LED::~LED() {
-	std::remove(leds().begin(), leds().end(), this);
-	leds().pop_back();
+	d_state->stopWaveform();
+	d_state->d_used = false;
 }
 
 void LED::ScheduleUpdateTask() {
@@ -53,7 +142,13 @@ void LED::Set(uint8_t level, uint pulsePeriod_us) {
 	s_updates.AddBlocking(ConfigUpdate{
 	    .Config =
 	        {.Level = level, .PulsePeriod_us = pulsePeriod_us, .BlinkCount = 0},
-	    .Self = this});
+	    .Self = d_state});
+}
+
+bool LED::Play(const LEDAnimation &animation) {
+	return s_updates.TryAdd(
+	    ConfigUpdate{.Config = {.Animation = &animation}, .Self = d_state}
+	);
 }
 
 void LED::Blink(uint count, uint8_t level) {
@@ -69,20 +164,40 @@ void LED::Blink(uint count, uint8_t level) {
 	            .PulsePeriod_us = 0,
 	            .BlinkCount     = static_cast<uint8_t>(count),
 	        },
-	    .Self = this});
+	    .Self = d_state});
 }
 
-void LED::performPulse(absolute_time_t now) {
-	if (d_config.PulsePeriod_us == 0) {
-		return;
+// level of a pulse at phase within its period.
+static uint16_t pulseLevel(uint64_t phase, uint64_t period, uint8_t level) {
+	phase *= 2;
+	if (phase >= period) {
+		phase = 2 * period - phase;
 	}
-	uint8_t target = d_config.Level;
-	uint    phase  = (now % d_config.PulsePeriod_us) * 2;
-	if (phase >= d_config.PulsePeriod_us) {
-		phase = std::max(0U, 2 * d_config.PulsePeriod_us - phase);
+	return luminance((phase * level << 8) / period);
+}
+
+constexpr static int BLINK_PULSE_LENGTH_US = 250 * 1000;
+
+static uint64_t blinkPeriod(uint8_t count) {
+	return 2 * (uint64_t(count) + 1) * BLINK_PULSE_LENGTH_US;
+}
+
+// count pulses followed by a pause.
+static uint16_t blinkLevel(uint64_t phase, uint8_t count, uint8_t level) {
+	uint64_t pulse = phase / BLINK_PULSE_LENGTH_US;
+	if (pulse >= 2 * uint64_t(count)) {
+		return 0;
 	}
+	return (pulse % 2) == 0 ? luminance(level << 8) : 0;
+}
 
-	target = phase * uint(d_config.Level) / d_config.PulsePeriod_us;
+void LED::State::performPulse(absolute_time_t now) {
+	if (d_config.PulsePeriod_us == 0) {
+		return;
+	}
+	uint     phase = now % d_config.PulsePeriod_us;
+	uint16_t target =
+	    pulseLevel(phase, d_config.PulsePeriod_us, d_config.Level);
 
 	Tracef(
 	    "[LED %d:%d]: phase: %d period: %d (%.2f%%) target: %d",
@@ -96,24 +211,31 @@ void LED::performPulse(absolute_time_t now) {
 	pwm_set_chan_level(d_slice, d_channel, target);
 }
 
-constexpr static int BLINK_PULSE_LENGTH_US = 250 * 1000;
-
-void LED::performBlink(absolute_time_t now) {
-	uint phase =
-	    (now / BLINK_PULSE_LENGTH_US) % (2 * (d_config.BlinkCount + 1));
-	if (phase >= 2 * d_config.BlinkCount) {
-		pwm_set_chan_level(d_slice, d_channel, 0);
-		return;
-	}
+void LED::State::performBlink(absolute_time_t now) {
+	uint64_t phase = now % blinkPeriod(d_config.BlinkCount);
 	pwm_set_chan_level(
 	    d_slice,
 	    d_channel,
-	    (phase % 2) == 0 ? d_config.Level : 0
+	    blinkLevel(phase, d_config.BlinkCount, d_config.Level)
 	);
 }
 
-void LED::work(absolute_time_t now) {
-	if (d_config.BlinkCount > 0) {
+void LED::State::performAnimation(absolute_time_t now) {
+	d_level = d_animator.Advance(absolute_time_diff_us(d_lastUpdate, now));
+	d_lastUpdate = now;
+	pwm_set_chan_level(d_slice, d_channel, luminance(d_level));
+	if (d_animator.Done()) {
+		// lets a stream of the other channel resume.
+		setConfig({.Level = uint8_t(d_level >> 8)});
+	}
+}
+
+void LED::State::work(absolute_time_t now) {
+	if (d_waveform != nullptr) {
+		return;
+	} else if (d_config.Animation != nullptr) {
+		performAnimation(now);
+	} else if (d_config.BlinkCount > 0) {
 		performBlink(now);
 	} else {
 		performPulse(now);
@@ -125,17 +247,248 @@ std::optional<int64_t> LED::updateAllTask(absolute_time_t now) {
 		update.Self->setConfig(update.Config);
 	}
 
-	for (const auto self : leds()) {
-		self->work(now);
+	for (auto &state : s_states) {
+		if (state.d_used) {
+			state.work(now);
+		}
 	}
 
 	return std::nullopt;
 }
 
-void LED::setConfig(const Config &config) {
+void LED::State::setConfig(const Config &config) {
 	d_config = config;
+	stopWaveform();
+
+	// a stream writes both channels of the slice, so only one of them is
+	// streamed, while the other is constant.
+	auto other         = partner();
+	bool otherConstant = other == nullptr || other->d_config.Constant();
+	if (other != nullptr) {
+		other->stopWaveform();
+	}
 
-	if (config.BlinkCount == 0 && config.PulsePeriod_us == 0) {
-		pwm_set_chan_level(d_slice, d_channel, config.Level);
+	if (config.Animation != nullptr) {
+		d_animator.Start(*config.Animation, d_level);
+		d_lastUpdate = get_absolute_time();
+	} else {
+		// pulses and blinks leave no level to start from.
+		d_level = config.Constant() ? config.Level << 8 : 0;
+	}
+
+	if (config.Constant()) {
+		pwm_set_chan_level(d_slice, d_channel, luminance(d_level));
+		if (otherConstant == false) {
+			other->startWaveform();
+		}
+	} else if (otherConstant && config.Animation == nullptr) {
+		startWaveform();
+	}
+}
+
+LED::State *LED::State::partner() {
+	for (auto &other : s_states) {
+		if (other.d_used && &other != this && other.d_slice == d_slice) {
+			return &other;
+		}
+	}
+	return nullptr;
+}
+
+bool LED::State::startWaveform() {
+	if (d_config.Animation != nullptr) {
+		return false;
+	}
+	Waveform *w = nullptr;
+	for (auto &candidate : s_waveforms) {
+		if (candidate.Used == false) {
+			w = &candidate;
+			break;
+		}
+	}
+	if (w == nullptr) {
+		return false;
+	}
+	if (w->Control < 0) {
+		int control = dma_claim_unused_channel(false);
+		int data    = dma_claim_unused_channel(false);
+		int timer   = dma_claim_unused_timer(false);
+		if (control < 0 || data < 0 || timer < 0) {
+			if (control >= 0) {
+				dma_channel_unclaim(control);
+			}
+			if (data >= 0) {
+				dma_channel_unclaim(data);
+			}
+			if (timer >= 0) {
+				dma_timer_unclaim(timer);
+			}
+			return false;
+		}
+		w->Control = control;
+		w->Data    = data;
+		w->Timer   = timer;
+		for (size_t i = 0; i < WAVEFORM_STEPS; ++i) {
+			w->Steps[i] = &w->Levels[i];
+		}
+	}
+	w->Used    = true;
+	d_waveform = w;
+
+	uint64_t period = d_config.BlinkCount > 0
+	                      ? blinkPeriod(d_config.BlinkCount)
+	                      : d_config.PulsePeriod_us;
+	uint     shift  = 16 * d_channel;
+	uint32_t other  = pwm_hw->slice[d_slice].cc & (0xffff0000 >> shift);
+	for (size_t i = 0; i < WAVEFORM_STEPS; ++i) {
+		uint64_t phase = i * period / WAVEFORM_STEPS;
+		uint32_t level =
+		    d_config.BlinkCount > 0
+		        ? blinkLevel(phase, d_config.BlinkCount, d_config.Level)
+		        : pulseLevel(phase, period, d_config.Level);
+		w->Levels[i] = other | (level << shift);
+	}
+	// the timer divides the system clock by at most 0xffff, so long steps
+	// take several writes. A step lasts writes * divider cycles, within
+	// half a write of its exact duration.
+	uint64_t cycles = std::max<uint64_t>(
+	    1,
+	    period * SYS_CLK_HZ / (WAVEFORM_STEPS * 1000000)
+	);
+	uint32_t writes  = (cycles + 0xfffe) / 0xffff;
+	uint32_t divider = (cycles + writes / 2) / writes;
+	dma_timer_set_fraction(w->Timer, 1, divider);
+
+	auto data = dma_channel_get_default_config(w->Data);
+	channel_config_set_transfer_data_size(&data, DMA_SIZE_32);
+	channel_config_set_read_increment(&data, false);
+	channel_config_set_write_increment(&data, false);
+	channel_config_set_dreq(&data, dma_get_timer_dreq(w->Timer));
+	channel_config_set_chain_to(&data, w->Control);
+	dma_channel_configure(
+	    w->Data,
+	    &data,
+	    &pwm_hw->slice[d_slice].cc,
+	    w->Steps[0],
+	    writes,
+	    false
+	);
+
+	auto control = dma_channel_get_default_config(w->Control);
+	channel_config_set_transfer_data_size(&control, DMA_SIZE_32);
+	channel_config_set_read_increment(&control, true);
+	channel_config_set_write_increment(&control, false);
+	channel_config_set_ring(
+	    &control,
+	    false,
+	    __builtin_ctz(sizeof(w->Steps))
+	);
+	dma_channel_configure(
+	    w->Control,
+	    &control,
+	    &dma_hw->ch[w->Data].al3_read_addr_trig,
+	    w->Steps,
+	    1,
+	    true
+	);
+	Debugf(
+	    "[LED %d:%d]: streaming %d steps of %d writes every %d cycles",
+	    d_slice,
+	    d_channel,
+	    int(WAVEFORM_STEPS),
+	    int(writes),
+	    int(divider)
+	);
+	return true;
+}
+
+void LED::State::stopWaveform() {
+	if (d_waveform == nullptr) {
+		return;
+	}
+	auto w = d_waveform;
+	// unchained first, or the data channel could restart the control one.
+	auto config = dma_get_channel_config(w->Data);
+	channel_config_set_chain_to(&config, w->Data);
+	dma_channel_set_config(w->Data, &config, false);
+	dma_channel_abort(w->Control);
+	dma_channel_abort(w->Data);
+
+	w->Used    = false;
+	d_waveform = nullptr;
+}
+
+LEDGroup::LEDGroup(std::initializer_list<uint> pins) {
+	if (pins.size() > PICO_LED_GROUP_MAX_CHANNELS) {
+		panic("[LEDGroup]: more than PICO_LED_GROUP_MAX_CHANNELS pins");
+	}
+	for (auto pin : pins) {
+		d_outputs[d_size++] = {
+		    .Slice   = uint8_t(pwm_gpio_to_slice_num(pin)),
+		    .Channel = uint8_t(pwm_gpio_to_channel(pin)),
+		};
+		d_slices |= 1 << pwm_gpio_to_slice_num(pin);
+		gpio_set_function(pin, GPIO_FUNC_PWM);
+	}
+
+	auto config = ledConfig();
+	for (uint slice = 0; slice < NUM_PWM_SLICES; ++slice) {
+		if (d_slices & (1 << slice)) {
+			// stopped with their counter reset.
+			pwm_init(slice, &config, false);
+		}
+	}
+	// a single write to the enable register starts all of them at once.
+	auto saved = save_and_disable_interrupts();
+	pwm_set_mask_enabled(pwm_hw->en | d_slices);
+	restore_interrupts(saved);
+}
+
+// counts before a wrap within which the compare registers may not all be
+// written in time for it.
+static constexpr uint32_t GROUP_WRAP_MARGIN = 128;
+
+// Compare registers are latched at the wrap, and the slices wrap together:
+// all of them are written within the same PWM period. This runs from RAM,
+// as an XIP cache miss could take longer than the margin.
+static void __not_in_flash_func(writeCompares)(
+    uint first, uint32_t slices, const uint32_t *cc
+) {
+	auto saved = save_and_disable_interrupts();
+	while (pwm_get_counter(first) > PWM_TOP - GROUP_WRAP_MARGIN) {
+		tight_loop_contents();
+	}
+	for (uint slice = 0; slice < NUM_PWM_SLICES; ++slice) {
+		if (slices & (1 << slice)) {
+			pwm_hw->slice[slice].cc = cc[slice];
+		}
+	}
+	restore_interrupts(saved);
+}
+
+void LEDGroup::Set(const uint8_t *levels) {
+	if (d_size == 0) {
+		return;
+	}
+	uint32_t cc[NUM_PWM_SLICES];
+	for (uint slice = 0; slice < NUM_PWM_SLICES; ++slice) {
+		if (d_slices & (1 << slice)) {
+			cc[slice] = pwm_hw->slice[slice].cc;
+		}
+	}
+	for (size_t i = 0; i < d_size; ++i) {
+		const auto &o     = d_outputs[i];
+		uint        shift = 16 * o.Channel;
+		cc[o.Slice] &= ~(0xffffU << shift);
+		cc[o.Slice] |= uint32_t(luminance(levels[i] << 8)) << shift;
 	}
+	writeCompares(d_outputs[0].Slice, d_slices, cc);
+}
+
+RGBLED::RGBLED(uint red, uint green, uint blue)
+    : LEDGroup{red, green, blue} {}
+
+void RGBLED::Set(const RGB &color) {
+	uint8_t levels[] = {color.R, color.G, color.B};
+	LEDGroup::Set(levels);
 }
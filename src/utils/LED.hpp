@@ -3,13 +3,48 @@
 #pragma once
 
 #include <cstdint>
+#include <initializer_list>
 #include <optional>
-#include <vector>
 
 #include <pico/types.h>
 
+#include <utils/Color.hpp>
+#include <utils/LEDAnimation.hpp>
 #include <utils/Queue.hpp>
 
+// Resolution and frequency of the PWM driving the LEDs.
+#ifndef PICO_LED_PWM_BITS
+#define PICO_LED_PWM_BITS 16
+#endif
+
+#ifndef PICO_LED_PWM_FREQUENCY_HZ
+#define PICO_LED_PWM_FREQUENCY_HZ 1000
+#endif
+
+// Maximal number of LED instances.
+#ifndef PICO_LED_MAX_LEDS
+#define PICO_LED_MAX_LEDS 8
+#endif
+
+// Maximal number of channels of an LEDGroup.
+#ifndef PICO_LED_GROUP_MAX_CHANNELS
+#define PICO_LED_GROUP_MAX_CHANNELS 4
+#endif
+
+// Number of LEDs whose pulse and blink waveforms are streamed to the PWM by
+// DMA, using two channels and a pacing timer each. The update task computes
+// the others.
+#ifndef PICO_LED_MAX_WAVEFORMS
+#define PICO_LED_MAX_WAVEFORMS 2
+#endif
+
+// Levels of a streamed waveform, a power of two.
+#ifndef PICO_LED_WAVEFORM_STEPS
+#define PICO_LED_WAVEFORM_STEPS 256
+#endif
+
+// Levels are perceived brightness, from 0 to 255, corrected to the
+// luminance of the LED.
 class LED {
 public:
 	LED(uint pin);
@@ -23,6 +58,11 @@ public:
 	void Set(uint8_t level, uint pulsePeriod_us = 0);
 	void Blink(uint count, uint8_t level = 255);
 
+	// Plays animation from the current level. Unlike Set() and Blink(), it
+	// can be called from interrupts, and returns false when too many updates
+	// are pending.
+	bool Play(const LEDAnimation &animation);
+
 	static void ScheduleUpdateTask();
 
 private:
@@ -30,25 +70,73 @@ private:
 		uint8_t Level          = 0;
 		uint    PulsePeriod_us = 0;
 		uint8_t BlinkCount     = 0;
+
+		const LEDAnimation *Animation = nullptr;
+
+		bool Constant() const {
+			return BlinkCount == 0 && PulsePeriod_us == 0 &&
+			       Animation == nullptr;
+		}
 	};
 
+	class State;
+	struct Waveform;
+
 	struct ConfigUpdate {
 		LED::Config Config;
-		LED        *Self;
+		State      *Self;
 	};
 
 	static std::optional<int64_t> updateAllTask(absolute_time_t now);
 
-	void work(absolute_time_t now);
+	// the update task walks through all of them, so they are kept together
+	// rather than in the instances.
+	static State                          s_states[];
+	static BlockingQueue<ConfigUpdate, 8> s_updates;
+	static Waveform                       s_waveforms[];
+
+	State *d_state;
+};
 
-	void setConfig(const Config &);
+// Channels whose PWM slices start together, so they stay in phase, and
+// whose levels change at the same PWM wrap, e.g. the colours of an RGB LED.
+// They should not share slices with LED instances.
+class LEDGroup {
+public:
+	LEDGroup(std::initializer_list<uint> pins);
 
-	void performBlink(absolute_time_t now);
-	void performPulse(absolute_time_t now);
+	LEDGroup(const LEDGroup &)            = delete;
+	LEDGroup(LEDGroup &&)                 = delete;
+	LEDGroup &operator=(const LEDGroup &) = delete;
+	LEDGroup &operator=(LEDGroup &&)      = delete;
 
-	static std::vector<LED *>            &leds();
-	static BlockingQueue<ConfigUpdate, 8> s_updates;
+	// Perceived levels of the channels, in the order of the pins. Can be
+	// called from interrupts.
+	void Set(const uint8_t *levels);
+
+	size_t Size() const {
+		return d_size;
+	}
+
+private:
+	struct Output {
+		uint8_t Slice, Channel;
+	};
+
+	Output   d_outputs[PICO_LED_GROUP_MAX_CHANNELS];
+	size_t   d_size   = 0;
+	uint32_t d_slices = 0;
+};
+
+class RGBLED : public LEDGroup {
+public:
+	RGBLED(uint red, uint green, uint blue);
+
+	using LEDGroup::Set;
+
+	void Set(const RGB &color);
 
-	uint   d_slice, d_channel;
-	Config d_config;
+	void Set(const HSV &color) {
+		Set(ToRGB(color));
+	}
 };
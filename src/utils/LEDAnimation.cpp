@@ -0,0 +1,75 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#include "LEDAnimation.hpp"
+
+namespace details {
+
+// progress t, out of 256, eased.
+static uint32_t ease(LEDEasing easing, uint32_t t) {
+	switch (easing) {
+	case LEDEasing::STEP:
+		return 256;
+	case LEDEasing::IN:
+		return t * t >> 8;
+	case LEDEasing::OUT:
+		return 256 - ((256 - t) * (256 - t) >> 8);
+	case LEDEasing::IN_OUT:
+		if (t < 128) {
+			return t * t >> 7;
+		}
+		return 256 - ((256 - t) * (256 - t) >> 7);
+	case LEDEasing::LINEAR:
+	default:
+		return t;
+	}
+}
+
+void LEDAnimator::Start(const LEDAnimation &animation, uint16_t from) {
+	d_animation  = animation.NbFrames > 0 ? &animation : nullptr;
+	d_elapsed_us = 0;
+	d_from       = from;
+	d_frame      = 0;
+	d_played     = 0;
+}
+
+bool LEDAnimator::nextFrame() {
+	if (++d_frame < d_animation->NbFrames) {
+		return true;
+	}
+	d_frame = 0;
+	if (d_animation->Repeat == 0 || ++d_played < d_animation->Repeat) {
+		return true;
+	}
+	d_played    = 0;
+	d_animation = d_animation->Next;
+	return d_animation != nullptr && d_animation->NbFrames > 0;
+}
+
+uint16_t LEDAnimator::Advance(uint32_t elapsed_us) {
+	if (d_animation == nullptr) {
+		return d_from;
+	}
+	d_elapsed_us += elapsed_us;
+	for (size_t i = 0; i <= d_animation->NbFrames; ++i) {
+		const auto &frame    = d_animation->Frames[d_frame];
+		uint32_t    duration = uint32_t(frame.Duration_ms) * 1000;
+		uint16_t    to       = frame.Level << 8;
+		if (d_elapsed_us < duration) {
+			// in units of 4us, the product fits in 32 bits.
+			uint32_t t     = (d_elapsed_us / 4) * 256 / (duration / 4);
+			int32_t  delta = int32_t(to) - int32_t(d_from);
+			return d_from + delta * int32_t(ease(frame.Easing, t)) / 256;
+		}
+		d_elapsed_us -= duration;
+		d_from = to;
+		if (nextFrame() == false) {
+			d_animation  = nullptr;
+			d_elapsed_us = 0;
+			return d_from;
+		}
+	}
+	d_elapsed_us = 0;
+	return d_from;
+}
+
+} // namespace details
@@ -0,0 +1,137 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+enum class LEDEasing : uint8_t {
+	// jumps to the level, then holds it.
+	STEP,
+	LINEAR,
+	IN,
+	OUT,
+	IN_OUT,
+};
+
+// Reaches Level, a perceived brightness, in Duration_ms from the level of
+// the previous keyframe.
+struct LEDKeyframe {
+	uint8_t   Level;
+	uint16_t  Duration_ms;
+	LEDEasing Easing = LEDEasing::LINEAR;
+};
+
+// Keyframes played Repeat times, or forever when 0, then followed by Next.
+// The LED keeps the last level when there is no Next. Animations and their
+// keyframes are meant to be constexpr, so they stay in flash.
+struct LEDAnimation {
+	const LEDKeyframe  *Frames;
+	uint8_t             NbFrames;
+	uint8_t             Repeat = 0;
+	const LEDAnimation *Next   = nullptr;
+};
+
+template <size_t N>
+constexpr LEDAnimation MakeLEDAnimation(
+    const LEDKeyframe (&frames)[N],
+    uint8_t             repeat = 0,
+    const LEDAnimation *next   = nullptr
+) {
+	static_assert(N > 0 && N < 256, "an animation has 1 to 255 keyframes");
+	return {.Frames = frames, .NbFrames = N, .Repeat = repeat, .Next = next};
+}
+
+namespace LEDPatterns {
+inline constexpr LEDKeyframe HEARTBEAT_FRAMES[] = {
+    {.Level = 255, .Duration_ms = 70, .Easing = LEDEasing::OUT},
+    {.Level = 60, .Duration_ms = 110, .Easing = LEDEasing::IN},
+    {.Level = 200, .Duration_ms = 70, .Easing = LEDEasing::OUT},
+    {.Level = 0, .Duration_ms = 350, .Easing = LEDEasing::IN},
+    {.Level = 0, .Duration_ms = 400, .Easing = LEDEasing::STEP},
+};
+
+inline constexpr LEDAnimation HEARTBEAT = MakeLEDAnimation(HEARTBEAT_FRAMES);
+
+#define LED_PATTERNS_ON(ms)                                                    \
+	{.Level = 255, .Duration_ms = ms, .Easing = LEDEasing::STEP}
+#define LED_PATTERNS_OFF(ms)                                                   \
+	{.Level = 0, .Duration_ms = ms, .Easing = LEDEasing::STEP}
+
+// ... --- ..., then a pause.
+inline constexpr LEDKeyframe SOS_FRAMES[] = {
+    LED_PATTERNS_ON(150),  LED_PATTERNS_OFF(150), LED_PATTERNS_ON(150),
+    LED_PATTERNS_OFF(150), LED_PATTERNS_ON(150),  LED_PATTERNS_OFF(450),
+    LED_PATTERNS_ON(450),  LED_PATTERNS_OFF(150), LED_PATTERNS_ON(450),
+    LED_PATTERNS_OFF(150), LED_PATTERNS_ON(450),  LED_PATTERNS_OFF(450),
+    LED_PATTERNS_ON(150),  LED_PATTERNS_OFF(150), LED_PATTERNS_ON(150),
+    LED_PATTERNS_OFF(150), LED_PATTERNS_ON(150),  LED_PATTERNS_OFF(1050),
+};
+
+inline constexpr LEDAnimation SOS = MakeLEDAnimation(SOS_FRAMES);
+
+// fast flashes.
+inline constexpr LEDKeyframe ALARM_FRAMES[] = {
+    LED_PATTERNS_ON(60),
+    LED_PATTERNS_OFF(60),
+};
+
+inline constexpr LEDAnimation ALARM = MakeLEDAnimation(ALARM_FRAMES);
+
+#undef LED_PATTERNS_ON
+#undef LED_PATTERNS_OFF
+} // namespace LEDPatterns
+
+namespace details {
+typedef std::array<uint16_t, 256> LEDGamma;
+
+// CIE 1931 luminance of the perceived levels, from 0 to top.
+constexpr LEDGamma MakeLEDGamma(uint32_t top) {
+	LEDGamma res{};
+	for (size_t i = 0; i < res.size(); ++i) {
+		double l = 100.0 * i / (res.size() - 1);
+		double y = l <= 8 ? l / 903.3 : (l + 16) / 116;
+		if (l > 8) {
+			y = y * y * y;
+		}
+		res[i] = uint16_t(y * top + 0.5);
+	}
+	return res;
+}
+
+// Luminance of a perceived level in 8.8 fixed point, interpolated between
+// the entries of the table so fades stay smooth at low brightness.
+inline uint16_t LEDLuminance(const LEDGamma &gamma, uint32_t level) {
+	uint32_t i = level >> 8;
+	if (i >= gamma.size() - 1) {
+		return gamma.back();
+	}
+	return gamma[i] + (uint32_t(gamma[i + 1] - gamma[i]) * (level & 0xff) >> 8);
+}
+
+// Plays an animation incrementally, with integer math. Levels are perceived
+// brightness in 8.8 fixed point.
+class LEDAnimator {
+public:
+	void Start(const LEDAnimation &animation, uint16_t from);
+
+	// Level after elapsed_us more. Walks at most once through the keyframes,
+	// skipping the time left when far behind.
+	uint16_t Advance(uint32_t elapsed_us);
+
+	bool Done() const {
+		return d_animation == nullptr;
+	}
+
+private:
+	bool nextFrame();
+
+	const LEDAnimation *d_animation  = nullptr;
+	uint32_t            d_elapsed_us = 0;
+	// level at the start of the keyframe.
+	uint16_t d_from   = 0;
+	uint8_t  d_frame  = 0;
+	uint8_t  d_played = 0;
+};
+} // namespace details
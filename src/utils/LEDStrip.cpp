@@ -0,0 +1,172 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#include "LEDStrip.hpp"
+
+#include <algorithm>
+
+#include <hardware/dma.h>
+#include <hardware/pio.h>
+#include <pico/time.h>
+
+#include <utils/Scheduler.hpp>
+
+// .program ws2812 of the SDK examples, with T1 = 2, T2 = 5 and T3 = 3:
+//     .side_set 1
+//     .wrap_target
+// bitloop:
+//     out x, 1       side 0 [T3 - 1]
+//     jmp !x do_zero side 1 [T1 - 1]
+// do_one:
+//     jmp bitloop    side 1 [T2 - 1]
+// do_zero:
+//     nop            side 0 [T2 - 1]
+//     .wrap
+static const uint16_t WS2812_INSTRUCTIONS[] = {0x6221, 0x1123, 0x1400, 0xa442};
+
+static const pio_program_t WS2812_PROGRAM = {
+    .instructions = WS2812_INSTRUCTIONS,
+    .length       = 4,
+    .origin       = -1,
+};
+
+static constexpr uint WS2812_CYCLES_PER_BIT = 10;
+static constexpr uint WS2812_BIT_RATE_HZ    = 800000;
+// 24 bits per pixel.
+static constexpr uint WS2812_PIXEL_US = 30;
+// low time latching the colours, longer than required by most variants.
+static constexpr uint WS2812_RESET_US = 300;
+
+std::vector<LEDStrip *> &LEDStrip::strips() {
+	static std::vector<LEDStrip *> s_strips;
+	return s_strips;
+}
+
+// offset of the program in each PIO, loaded once for all their strips.
+static uint loadProgram(PIO pio) {
+	static uint s_loaded = 0;
+	static uint s_offsets[NUM_PIOS];
+
+	uint idx = pio_get_index(pio);
+	if ((s_loaded & (1 << idx)) == 0) {
+		s_offsets[idx] = pio_add_program(pio, &WS2812_PROGRAM);
+		s_loaded |= 1 << idx;
+	}
+	return s_offsets[idx];
+}
+
+LEDStrip::LEDStrip(uint pin, size_t count, PIO pio)
+    : d_pio{pio}
+    , d_sm{uint(pio_claim_unused_sm(pio, true))}
+    , d_channel{dma_claim_unused_channel(true)}
+    , d_pixels(count, RGB{0, 0, 0})
+    , d_frames{std::vector<uint32_t>(count), std::vector<uint32_t>(count)} {
+
+	uint offset = loadProgram(pio);
+	auto config = pio_get_default_sm_config();
+	sm_config_set_wrap(&config, offset, offset + WS2812_PROGRAM.length - 1);
+	sm_config_set_sideset(&config, 1, false, false);
+	sm_config_set_sideset_pins(&config, pin);
+	// 24 bits per pixel, from the most significant one.
+	sm_config_set_out_shift(&config, false, true, 24);
+	sm_config_set_fifo_join(&config, PIO_FIFO_JOIN_TX);
+	sm_config_set_clkdiv(
+	    &config,
+	    float(SYS_CLK_HZ) / (WS2812_BIT_RATE_HZ * WS2812_CYCLES_PER_BIT)
+	);
+	pio_gpio_init(pio, pin);
+	pio_sm_set_consecutive_pindirs(pio, d_sm, pin, 1, true);
+	pio_sm_init(pio, d_sm, offset, &config);
+	pio_sm_set_enabled(pio, d_sm, true);
+
+	auto dma = dma_channel_get_default_config(d_channel);
+	channel_config_set_transfer_data_size(&dma, DMA_SIZE_32);
+	channel_config_set_read_increment(&dma, true);
+	channel_config_set_write_increment(&dma, false);
+	channel_config_set_dreq(&dma, pio_get_dreq(pio, d_sm, true));
+	dma_channel_configure(
+	    d_channel,
+	    &dma,
+	    &pio->txf[d_sm],
+	    nullptr,
+	    count,
+	    false
+	);
+
+	// the strip may hold colours from before a reset.
+	Show();
+	strips().push_back(this);
+}
+
+LEDStrip::~LEDStrip() {
+	auto &s = strips();
+	s.erase(std::remove(s.begin(), s.end(), this), s.end());
+
+	dma_channel_abort(d_channel);
+	dma_channel_unclaim(d_channel);
+	pio_sm_set_enabled(d_pio, d_sm, false);
+	pio_sm_unclaim(d_pio, d_sm);
+}
+
+void LEDStrip::Show() {
+	d_shown.store(true);
+}
+
+void LEDStrip::SetBrightness(uint8_t level) {
+	d_updates.AddBlocking(Update{.Level = level, .Animation = nullptr});
+}
+
+bool LEDStrip::Play(const LEDAnimation &animation) {
+	return d_updates.TryAdd(Update{.Level = 0, .Animation = &animation});
+}
+
+void LEDStrip::ScheduleUpdateTask() {
+	Scheduler::Get().Schedule(
+	    1000000 / PICO_LED_STRIP_FRAME_RATE_HZ,
+	    updateAllTask,
+	    {.Start = 0}
+	);
+}
+
+std::optional<int64_t> LEDStrip::updateAllTask(absolute_time_t now) {
+	for (const auto self : strips()) {
+		self->work(now);
+	}
+	return std::nullopt;
+}
+
+void LEDStrip::work(absolute_time_t now) {
+	bool changed = d_shown.exchange(false);
+	for (Update update; d_updates.TryRemove(update);) {
+		if (update.Animation != nullptr) {
+			d_animator.Start(*update.Animation, d_brightness);
+			d_lastUpdate = now;
+		} else {
+			d_animator   = {};
+			d_brightness = update.Level << 8;
+		}
+		changed = true;
+	}
+	if (d_animator.Done() == false) {
+		d_brightness =
+		    d_animator.Advance(absolute_time_diff_us(d_lastUpdate, now));
+		d_lastUpdate = now;
+		changed      = true;
+	}
+
+	// the back buffer is not being sent, and can be encoded again until it
+	// is.
+	auto &frame = d_frames[d_back];
+	if (changed) {
+		d_encoder.SetBrightness(d_brightness);
+		d_encoder.Encode(d_pixels.data(), d_pixels.size(), frame.data());
+		d_ready = true;
+	}
+	if (d_ready == false || time_reached(d_busyUntil) == false) {
+		return;
+	}
+	dma_channel_transfer_from_buffer_now(d_channel, frame.data(), frame.size());
+	d_busyUntil =
+	    delayed_by_us(now, frame.size() * WS2812_PIXEL_US + WS2812_RESET_US);
+	d_back ^= 1;
+	d_ready = false;
+}
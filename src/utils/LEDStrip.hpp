@@ -0,0 +1,86 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <hardware/pio.h>
+#include <pico/types.h>
+
+#include <utils/LEDAnimation.hpp>
+#include <utils/Queue.hpp>
+#include <utils/WS2812.hpp>
+
+// Maximal frame rate of the strips, the period of their update task.
+#ifndef PICO_LED_STRIP_FRAME_RATE_HZ
+#define PICO_LED_STRIP_FRAME_RATE_HZ 60
+#endif
+
+// A strip of WS2812 addressable LEDs, driven by a PIO state machine fed by
+// DMA. Frames are encoded by the update task into a buffer while the other
+// one is sent, so the CPU never waits for the strip.
+class LEDStrip {
+public:
+	LEDStrip(uint pin, size_t count, PIO pio = pio0);
+	~LEDStrip();
+
+	LEDStrip(const LEDStrip &)            = delete;
+	LEDStrip(LEDStrip &&)                 = delete;
+	LEDStrip &operator=(const LEDStrip &) = delete;
+	LEDStrip &operator=(LEDStrip &&)      = delete;
+
+	// Colours of the LEDs, modified on the core of the update task. They are
+	// sent at the next frame after Show().
+	RGB *Pixels() {
+		return d_pixels.data();
+	}
+
+	size_t Size() const {
+		return d_pixels.size();
+	}
+
+	void Show();
+
+	// Brightness of the whole strip, as a perceived level like LED::Set().
+	void SetBrightness(uint8_t level);
+
+	// Animates the brightness of the whole strip, like LED::Play(). Can be
+	// called from interrupts, false when too many updates are pending.
+	bool Play(const LEDAnimation &animation);
+
+	static void ScheduleUpdateTask();
+
+private:
+	struct Update {
+		uint8_t             Level;
+		const LEDAnimation *Animation;
+	};
+
+	static std::optional<int64_t> updateAllTask(absolute_time_t now);
+
+	void work(absolute_time_t now);
+
+	static std::vector<LEDStrip *> &strips();
+
+	PIO  d_pio;
+	uint d_sm;
+	int  d_channel;
+
+	std::vector<RGB>       d_pixels;
+	std::vector<uint32_t>  d_frames[2];
+	details::WS2812Encoder d_encoder;
+	// d_frames[d_back] is encoded and not sent yet when d_ready.
+	uint8_t           d_back  = 0;
+	bool              d_ready = false;
+	std::atomic<bool> d_shown{false};
+	// end of the frame sent, including the reset of the strip.
+	absolute_time_t d_busyUntil = 0;
+
+	BlockingQueue<Update, 4> d_updates;
+	details::LEDAnimator     d_animator;
+	uint16_t                 d_brightness = 255 << 8;
+	absolute_time_t          d_lastUpdate = 0;
+};
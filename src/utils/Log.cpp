@@ -15,6 +15,11 @@
 
 #include <utils/Scheduler.hpp>
 
+#if PICO_LOG_PERSISTENT
+__attribute__((section(".uninitialized_data.logger")))
+#endif
+Logger::Storage Logger::s_storage;
+
 void Logger::Logf(Level level, const char *fmt, va_list args) {
 	if (level > d_level) {
 		return;
@@ -22,35 +27,314 @@ void Logger::Logf(Level level, const char *fmt, va_list args) {
 
 	auto now = get_absolute_time();
 
-	auto written =
-	    vsnprintf(d_buffer.data() + d_start, BufferSize - d_start, fmt, args);
-
-	while (d_start + written >= BufferSize) {
-		if (d_start == 0) {
-			d_buffer[BufferSize - 1] = 0;
+	// formatting is done before taking the lock, which disables interrupts
+	// and makes the other core spin.
+	char formatted[MaxMessageSize];
+	int  written = vsnprintf(formatted, sizeof(formatted), fmt, args);
+	written      = std::clamp(written, 0, int(MaxMessageSize - 1));
 
-			written = BufferSize - 1;
-		} else {
+	auto &s     = s_storage;
+	auto  saved = spin_lock_blocking(d_lock);
 
-			d_start = 0;
-			written = vsnprintf(d_buffer.data(), BufferSize, fmt, args);
-		}
+	if (s.Start + sizeof(Record) + written + 1 > BufferSize) {
+		wrap();
 	}
-	va_end(args);
+	size_t start = s.Start;
+	reserve(start + sizeof(Record) + written + 1);
+
+	char *text = s.Buffer.data() + start + sizeof(Record);
+	memcpy(text, formatted, written + 1);
+
+	Record record = {
+	    .Time   = now,
+	    .Length = uint16_t(written),
+	    .Level  = uint8_t(level),
+	};
+	record.Checksum = recordChecksum(record, text);
+	memcpy(s.Buffer.data() + start, &record, sizeof(Record));
+
+	s.Start    = start + sizeof(Record) + written + 1;
+	s.Checksum = headerChecksum(s);
+	spin_unlock(d_lock, saved);
 
 	Message m = {
-	    .Value = d_buffer.data() + d_start,
+	    .Value = text,
 	    .Time  = now,
 	    .Level = level,
 	};
 
-	if (d_queue.TryAdd(std::move(m)) == true) {
-		d_start += written + 1;
+	d_queue.TryAdd(std::move(m));
+}
+
+void Logger::logf(Level level, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	Logf(level, fmt, args);
+	va_end(args);
+}
+
+static uint32_t hashString(const char *str) {
+	uint32_t hash = 2166136261u;
+	for (; *str != 0; ++str) {
+		hash = (hash ^ uint8_t(*str)) * 16777619u;
+	}
+	return hash;
+}
+
+void Logger::LogfLimited(CallSite &site, Level level, const char *fmt, ...) {
+	if (level > d_level) {
+		return;
+	}
+
+	constexpr static int64_t Period_us = PICO_LOG_RATE_PERIOD_US;
+
+	auto now   = get_absolute_time();
+	auto saved = spin_lock_blocking(d_lock);
+	if (site.d_registered == false) {
+		site.d_registered = true;
+		site.d_level      = level;
+		site.d_refill     = now;
+		site.d_next       = d_sites;
+		d_sites           = &site;
+	}
+	site.d_last      = now;
+	site.d_credit_us = std::min(
+	    site.d_credit_us + absolute_time_diff_us(site.d_refill, now),
+	    CallSite::Bucket_us
+	);
+	site.d_refill = now;
+	if (site.d_credit_us < Period_us) {
+		++site.d_suppressed;
+		spin_unlock(d_lock, saved);
+		return;
+	}
+	site.d_credit_us -= Period_us;
+	spin_unlock(d_lock, saved);
+
+	char    text[MaxLimitedMessageSize];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(text, sizeof(text), fmt, args);
+	va_end(args);
+	auto hash = hashString(text);
+
+	saved = spin_lock_blocking(d_lock);
+	if (site.d_logged && site.d_hash == hash) {
+		++site.d_repeated;
+		spin_unlock(d_lock, saved);
+		return;
+	}
+	uint repeated     = site.d_repeated;
+	uint suppressed   = site.d_suppressed;
+	site.d_logged     = true;
+	site.d_hash       = hash;
+	site.d_repeated   = 0;
+	site.d_suppressed = 0;
+	spin_unlock(d_lock, saved);
+
+	reportSuppressed(site, repeated, suppressed);
+	logf(level, "%s", text);
+}
+
+void Logger::reportSuppressed(
+    const CallSite &site, uint repeated, uint suppressed
+) {
+	if (repeated == 0 && suppressed == 0) {
+		return;
+	}
+	const char *file = strrchr(site.d_file, '/');
+	file             = file == nullptr ? site.d_file : file + 1;
+	logf(
+	    site.d_level,
+	    "%s:%d: last message repeated %u time(s), %u message(s) suppressed",
+	    file,
+	    site.d_line,
+	    repeated,
+	    suppressed
+	);
+}
+
+void Logger::ReportQuietCallSites(absolute_time_t now) {
+	auto &self  = Logger::Get();
+	auto  saved = spin_lock_blocking(self.d_lock);
+	auto  site  = self.d_sites;
+	spin_unlock(self.d_lock, saved);
+
+	for (; site != nullptr; site = site->d_next) {
+		saved = spin_lock_blocking(self.d_lock);
+		if ((site->d_repeated == 0 && site->d_suppressed == 0) ||
+		    absolute_time_diff_us(site->d_last, now) <
+		        PICO_LOG_QUIET_PERIOD_US) {
+			spin_unlock(self.d_lock, saved);
+			continue;
+		}
+		uint repeated      = site->d_repeated;
+		uint suppressed    = site->d_suppressed;
+		site->d_logged     = false;
+		site->d_repeated   = 0;
+		site->d_suppressed = 0;
+		spin_unlock(self.d_lock, saved);
+
+		self.reportSuppressed(*site, repeated, suppressed);
+	}
+}
+
+Logger::Logger()
+    : d_lock{spin_lock_instance(next_striped_spin_lock_num())} {
+	s_storage.Buffer[BufferSize] = 0;
+	if (PICO_LOG_PERSISTENT == 0 || validate() == false) {
+		reset();
+	}
+}
+
+uint32_t Logger::headerChecksum(const Storage &s) {
+	// FNV-1a over the header fields
+	uint32_t hash = 2166136261u;
+	for (uint32_t v : {s.Magic, s.Start, s.Oldest, s.Wrap}) {
+		hash = (hash ^ v) * 16777619u;
+	}
+	return hash;
+}
+
+uint8_t Logger::recordChecksum(const Record &record, const char *text) {
+	uint8_t sum = record.Level ^ record.Length ^ (record.Length >> 8) ^
+	              uint8_t(record.Time) ^ uint8_t(record.Time >> 8);
+	for (size_t i = 0; i < record.Length; ++i) {
+		sum = (sum << 1 | sum >> 7) ^ uint8_t(text[i]);
+	}
+	return sum;
+}
+
+Logger::Record Logger::readRecord(size_t offset) const {
+	Record res;
+	memcpy(&res, s_storage.Buffer.data() + offset, sizeof(Record));
+	return res;
+}
+
+size_t Logger::recordSize(size_t offset) const {
+	return sizeof(Record) + readRecord(offset).Length + 1;
+}
+
+void Logger::dropOldest() {
+	auto &s = s_storage;
+	s.Oldest += recordSize(s.Oldest);
+	if (s.Oldest >= s.Wrap) {
+		s.Oldest = 0;
+		s.Wrap   = 0;
+	}
+	if (d_recovered > 0) {
+		--d_recovered;
+	}
+}
+
+void Logger::reserve(size_t end) {
+	auto &s = s_storage;
+	if (s.Wrap == 0 || s.Oldest >= end) {
+		return;
+	}
+	while (s.Wrap != 0 && s.Oldest < end) {
+		dropOldest();
+	}
+	s.Checksum = headerChecksum(s);
+}
+
+void Logger::wrap() {
+	auto &s = s_storage;
+	// Messages of the previous round are older than [0,Start) but would end
+	// up interleaved with the new ones, they are dropped first.
+	while (s.Wrap != 0) {
+		dropOldest();
+	}
+	s.Wrap     = s.Start;
+	s.Oldest   = 0;
+	s.Start    = 0;
+	s.Checksum = headerChecksum(s);
+}
+
+void Logger::reset() {
+	auto &s    = s_storage;
+	s.Magic    = StorageMagic;
+	s.Start    = 0;
+	s.Oldest   = 0;
+	s.Wrap     = 0;
+	s.Checksum = headerChecksum(s);
+}
+
+bool Logger::validate() {
+	auto &s = s_storage;
+	if (s.Magic != StorageMagic || s.Checksum != headerChecksum(s) ||
+	    s.Start >= BufferSize || s.Wrap >= BufferSize ||
+	    (s.Wrap != 0 && (s.Oldest < s.Start || s.Oldest >= s.Wrap))) {
+		return false;
+	}
+
+	// Counts the valid records in [from,to). They must tile it exactly.
+	auto countRecords = [this](size_t from, size_t to
+	                    ) -> std::optional<size_t> {
+		size_t count = 0;
+		while (from < to) {
+			if (from + sizeof(Record) >= to) {
+				return std::nullopt;
+			}
+			auto        record = readRecord(from);
+			const char *text = s_storage.Buffer.data() + from + sizeof(Record);
+			if (from + sizeof(Record) + record.Length >= to ||
+			    text[record.Length] != 0 ||
+			    record.Level > uint8_t(Level::TRACE) ||
+			    record.Checksum != recordChecksum(record, text)) {
+				return std::nullopt;
+			}
+			from += sizeof(Record) + record.Length + 1;
+			++count;
+		}
+		return count;
+	};
+
+	auto current = countRecords(0, s.Start);
+	if (current.has_value() == false) {
+		return false;
+	}
+	d_recovered = current.value();
+
+	if (s.Wrap != 0) {
+		// Only the current round is required to be intact, a corrupted
+		// older round is simply discarded.
+		auto older = countRecords(s.Oldest, s.Wrap);
+		if (older.has_value()) {
+			d_recovered += older.value();
+		} else {
+			s.Oldest   = 0;
+			s.Wrap     = 0;
+			s.Checksum = headerChecksum(s);
+		}
 	}
+	return true;
 }
 
-Logger::Logger() {
-	d_buffer[BufferSize] = 0;
+void Logger::ForEachRecovered(const std::function<void(const Message &)> &apply
+) const {
+	const auto &s = s_storage;
+	// the previous round, in [Oldest,Wrap), comes before [0,Start).
+	bool   previous  = s.Wrap != 0;
+	size_t offset    = previous ? s.Oldest : 0;
+	size_t end       = previous ? s.Wrap : s.Start;
+	size_t remaining = d_recovered;
+
+	while (remaining > 0 && offset < end) {
+		auto record = readRecord(offset);
+		apply(Message{
+		    .Value = s.Buffer.data() + offset + sizeof(Record),
+		    .Time  = record.Time,
+		    .Level = Level(record.Level),
+		});
+		--remaining;
+		offset += sizeof(Record) + record.Length + 1;
+		if (previous && offset >= end) {
+			previous = false;
+			offset   = 0;
+			end      = s.Start;
+		}
+	}
 }
 
 constexpr static size_t LineWidth = 80;
@@ -62,7 +346,7 @@ void printTime(absolute_time_t time) {
 	printf("       %06d.%06ds: ", s, us);
 }
 
-bool Logger::FormatsNextPendingLog() {
+static void printMessage(const Logger::Message &msg) {
 	static uint8_t colors[6] = {
 	    1, // FATAL - RED
 	    1, // ERROR - RED
@@ -72,12 +356,6 @@ bool Logger::FormatsNextPendingLog() {
 	    4, // TRACE - BLUE
 	};
 
-	struct Message msg;
-
-	if (Logger::Get().d_queue.TryRemove(msg) == false) {
-		return false;
-	}
-
 	char  *msgStr = const_cast<char *>(msg.Value);
 	size_t n      = strlen(msgStr);
 	auto   c      = colors[size_t(msg.Level)];
@@ -106,13 +384,43 @@ bool Logger::FormatsNextPendingLog() {
 		printf("%*s┃\n", space, "");
 		i += willWrite;
 	}
+}
+
+bool Logger::FormatsNextPendingLog() {
+	struct Message msg;
+
+	if (Logger::Get().d_queue.TryRemove(msg) == false) {
+		return false;
+	}
+
+	printMessage(msg);
 	return true;
 }
 
+void Logger::PrintRecovered() {
+	auto &self = Logger::Get();
+	if (self.d_recovered == 0) {
+		return;
+	}
+	printf("---- %d message(s) logged before reset ----\n", self.d_recovered);
+	self.ForEachRecovered(printMessage);
+	printf("---- end of recovered messages ----\n");
+	self.d_recovered = 0;
+}
+
 void Logger::ScheduleLogFormatting() {
 	Scheduler::Get().Schedule(
 	    1000,
 	    FormatsNextPendingLog,
 	    {.Priority = SCHEDULER_LOW_PRIORITY, .Name = "log/output"}
 	);
+
+	Scheduler::Get().Schedule(
+	    PICO_LOG_QUIET_PERIOD_US / 4,
+	    [](absolute_time_t now) -> std::optional<int64_t> {
+		    ReportQuietCallSites(now);
+		    return std::nullopt;
+	    },
+	    {.Priority = SCHEDULER_LOW_PRIORITY, .Name = "log/suppressed"}
+	);
 }
@@ -3,6 +3,7 @@
 #pragma once
 
 extern "C" {
+#include <hardware/sync.h>
 #include <pico/time.h>
 #include <pico/types.h>
 }
@@ -11,10 +12,41 @@ extern "C" {
 
 #include <array>
 #include <cstdio>
+#include <functional>
 #include <string>
 
 #include <utils/Queue.hpp>
 
+// When set, the log buffer lives in uninitialized RAM and survives a panic,
+// a watchdog or a soft reset. Messages found there at boot can be inspected
+// with Logger::ForEachRecovered() or Logger::PrintRecovered().
+#ifndef PICO_LOG_PERSISTENT
+#define PICO_LOG_PERSISTENT 0
+#endif
+
+// Token bucket of the rate limited macros (ErrorfLimited() ...): a call site
+// may log PICO_LOG_RATE_BURST messages at once, then one message per
+// PICO_LOG_RATE_PERIOD_US.
+#ifndef PICO_LOG_RATE_BURST
+#define PICO_LOG_RATE_BURST 5
+#endif
+
+#ifndef PICO_LOG_RATE_PERIOD_US
+#define PICO_LOG_RATE_PERIOD_US 1000000
+#endif
+
+// A rate limited call site is considered quiet, and its suppressed messages
+// are reported, after not being reached for that long.
+#ifndef PICO_LOG_QUIET_PERIOD_US
+#define PICO_LOG_QUIET_PERIOD_US 1000000
+#endif
+
+// Messages are formatted on the stack of the caller, which may be an
+// interrupt or core 1, and truncated to this size.
+#ifndef PICO_LOG_MAX_MESSAGE_SIZE
+#define PICO_LOG_MAX_MESSAGE_SIZE 128
+#endif
+
 class Logger {
 public:
 	static Logger &Get() {
@@ -37,25 +69,117 @@ public:
 		enum Level      Level;
 	};
 
+	// State of a rate limited call site. Only meant to be instantiated as a
+	// function local static by the *Limited() macros.
+	class CallSite {
+	public:
+		constexpr CallSite(const char *file, int line)
+		    : d_file{file}
+		    , d_line{line} {}
+
+	private:
+		friend class Logger;
+
+		static constexpr int64_t Bucket_us =
+		    PICO_LOG_RATE_BURST * int64_t(PICO_LOG_RATE_PERIOD_US);
+
+		const char     *d_file;
+		int             d_line;
+		CallSite       *d_next       = nullptr;
+		bool            d_registered = false;
+		Level           d_level      = Level::INFO;
+		bool            d_logged     = false;
+		int64_t         d_credit_us  = Bucket_us;
+		absolute_time_t d_refill     = 0;
+		absolute_time_t d_last       = 0;
+		uint32_t        d_hash       = 0;
+		uint            d_repeated   = 0;
+		uint            d_suppressed = 0;
+	};
+
 	void Logf(Level level, const char *fmt, va_list args);
 
+	void LogfLimited(CallSite &site, Level level, const char *fmt, ...)
+	    __attribute__((format(printf, 4, 5)));
+
 	inline void SetLevel(Level lvl) {
 		d_level = lvl;
 	}
 
+	// Number of messages still in the buffer that were logged before the
+	// last reset. Always 0 unless PICO_LOG_PERSISTENT is set.
+	inline size_t Recovered() const {
+		return d_recovered;
+	}
+
+	// Calls apply on each recovered message, oldest first. New messages
+	// overwrite the oldest recovered ones, so it should be called before
+	// logging resumes.
+	void ForEachRecovered(const std::function<void(const Message &)> &apply
+	) const;
+
+	static void PrintRecovered();
+
 	static bool FormatsNextPendingLog();
 
+	// Reports the suppressed messages of rate limited call sites that
+	// became quiet. Scheduled by ScheduleLogFormatting().
+	static void ReportQuietCallSites(absolute_time_t now);
+
 	static void ScheduleLogFormatting();
 
 private:
 	Logger();
 
-	static constexpr size_t BufferSize = 4096 * 4;
+	static constexpr size_t   BufferSize            = 4096 * 4;
+	static constexpr size_t   MaxMessageSize        = PICO_LOG_MAX_MESSAGE_SIZE;
+	static constexpr size_t   MaxLimitedMessageSize = 128;
+	static constexpr uint32_t StorageMagic   = 0x4c4f4721;
+
+	// Each message is stored in the buffer as a Record immediately followed
+	// by its NULL terminated text.
+	struct Record {
+		absolute_time_t Time;
+		uint16_t        Length;
+		uint8_t         Level;
+		uint8_t         Checksum;
+	};
+
+	// Messages are stored in [Oldest,Wrap) followed by [0,Start). Wrap is 0
+	// until the buffer wrapped around once.
+	struct Storage {
+		uint32_t                         Magic;
+		uint32_t                         Start;
+		uint32_t                         Oldest;
+		uint32_t                         Wrap;
+		uint32_t                         Checksum;
+		std::array<char, BufferSize + 1> Buffer;
+	};
+
+	static uint32_t headerChecksum(const Storage &storage);
+	static uint8_t  recordChecksum(const Record &record, const char *text);
 
-	std::array<char, BufferSize + 1> d_buffer;
-	size_t                           d_start = 0;
-	BlockingQueue<Message, 64>       d_queue;
-	Level                            d_level = Level::INFO;
+	Record readRecord(size_t offset) const;
+	size_t recordSize(size_t offset) const;
+
+	bool validate();
+	void reset();
+	void wrap();
+	void reserve(size_t end);
+	void dropOldest();
+
+	void logf(Level level, const char *fmt, ...)
+	    __attribute__((format(printf, 3, 4)));
+
+	void reportSuppressed(const CallSite &site, uint repeated, uint suppressed);
+
+	static Storage s_storage;
+
+	spin_lock_t               *d_lock;
+	CallSite                  *d_sites = nullptr;
+	BlockingQueue<Message, 64> d_queue;
+	Level                      d_level     = Level::INFO;
+	size_t                     d_recovered = 0;
 };
 
 inline static void Fatalf(const char *fmt, ...)
@@ -64,6 +188,9 @@ inline static void Fatalf(const char *fmt, ...)
 inline static void Fatalf(const char *fmt, ...) {
 	va_list args;
 	va_start(args, fmt);
+	Logger::Get().Logf(Logger::Level::FATAL, fmt, args);
+	va_end(args);
+	va_start(args, fmt);
 	panic((std::string("Fatal error: ") + fmt).c_str(), args);
 	va_end(args);
 }
@@ -125,3 +252,15 @@ inline static void Tracef(const char *fmt, ...) {
 #else
 inline static void Tracef(const char *fmt, ...) {}
 #endif
+
+#define LOG_LIMITED(level, ...)                                                \
+	do {                                                                       \
+		static Logger::CallSite _logCallSite{__FILE__, __LINE__};              \
+		Logger::Get().LogfLimited(_logCallSite, level, __VA_ARGS__);           \
+	} while (0)
+
+// Same as their non-limited counterparts, but a single call site is rate
+// limited and its consecutive duplicated messages are collapsed.
+#define ErrorfLimited(...) LOG_LIMITED(Logger::Level::ERROR, __VA_ARGS__)
+#define WarnfLimited(...)  LOG_LIMITED(Logger::Level::WARNING, __VA_ARGS__)
+#define InfofLimited(...)  LOG_LIMITED(Logger::Level::INFO, __VA_ARGS__)
@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "RotaryEncoder.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+
+#include <hardware/gpio.h>
+#include <hardware/pio.h>
+#include <pico/platform/panic.h>
+#include <pico/time.h>
+
+#include <utils/Scheduler.hpp>
+
+namespace details {
+// With shifts to the left, and the level of the pins as B << 1 | A. The
+// steps forward are 00 -> 01 -> 11 -> 10 -> 00, the jumps between opposite
+// levels are ignored.
+//     .origin 0
+//     ; previous << 2 | current
+//     jmp update        ; 00 00
+//     jmp increment     ; 00 01
+//     jmp decrement     ; 00 10
+//     jmp update        ; 00 11
+//     jmp decrement     ; 01 00
+//     jmp update        ; 01 01
+//     jmp update        ; 01 10
+//     jmp increment     ; 01 11
+//     jmp increment     ; 10 00
+//     jmp update        ; 10 01
+//     jmp update        ; 10 10
+//     jmp decrement     ; 10 11
+//     jmp update        ; 11 00
+//     jmp decrement     ; 11 01
+//     jmp increment     ; 11 10
+//     jmp update        ; 11 11
+// decrement:
+//     jmp y--, update
+//     .wrap_target
+// update:
+//     mov isr, y
+//     push noblock
+// start:
+//     mov isr, null
+//     in osr, 2
+//     in pins, 2
+//     mov osr, isr
+//     mov pc, isr
+// increment:
+//     mov y, ~y
+//     jmp y--, increment_done
+// increment_done:
+//     mov y, ~y
+//     .wrap
+const uint16_t QUADRATURE_INSTRUCTIONS[27] = {
+    0x0011, 0x0018, 0x0010, 0x0011, 0x0010, 0x0011, 0x0011, 0x0018, 0x0018,
+    0x0011, 0x0011, 0x0010, 0x0011, 0x0010, 0x0018, 0x0011, 0x0091, 0xa0c2,
+    0x8000, 0xa0c3, 0x40e2, 0x4002, 0xa0e6, 0xa0a6, 0xa04a, 0x009a, 0xa04a,
+};
+
+// factor of the detents from the given rate.
+struct Acceleration {
+	uint32_t Rate;
+	int32_t  Factor;
+};
+
+static constexpr Acceleration ACCELERATIONS[] = {
+    {.Rate = 40, .Factor = 8},
+    {.Rate = 20, .Factor = 4},
+    {.Rate = 10, .Factor = 2},
+};
+
+std::optional<EncoderDetents::Event>
+EncoderDetents::Update(int32_t count, absolute_time_t now) {
+	// the count wraps around, as well as the difference.
+	int32_t steps = int32_t(uint32_t(count) - uint32_t(d_origin));
+	int32_t delta = steps / d_stepsPerDetent;
+	if (delta == 0) {
+		return std::nullopt;
+	}
+	d_origin += delta * d_stepsPerDetent;
+
+	int64_t elapsed = std::max<int64_t>(absolute_time_diff_us(d_last, now), 1);
+	int64_t rate    = int64_t(std::abs(delta)) * 1000 * 1000 / elapsed;
+	d_last          = now;
+
+	int32_t factor = 1;
+	for (const auto &a : ACCELERATIONS) {
+		if (rate >= a.Rate) {
+			factor = a.Factor;
+			break;
+		}
+	}
+	return Event{
+	    .Delta       = delta,
+	    .Accelerated = delta * factor,
+	    .Rate        = uint32_t(std::min<int64_t>(rate, UINT32_MAX)),
+	};
+}
+} // namespace details
+
+static const pio_program_t QUADRATURE_PROGRAM = {
+    .instructions = details::QUADRATURE_INSTRUCTIONS,
+    .length       = std::size(details::QUADRATURE_INSTRUCTIONS),
+    .origin       = 0,
+};
+
+// the program is loaded once in each PIO, for all their encoders.
+static void loadProgram(PIO pio) {
+	static uint s_loaded = 0;
+
+	uint idx = pio_get_index(pio);
+	if ((s_loaded & (1 << idx)) == 0) {
+		if (pio_can_add_program(pio, &QUADRATURE_PROGRAM) == false) {
+			panic("[RotaryEncoder]: no room at offset 0 of PIO %d", idx);
+		}
+		pio_add_program(pio, &QUADRATURE_PROGRAM);
+		s_loaded |= 1 << idx;
+	}
+}
+
+std::vector<RotaryEncoder *> &RotaryEncoder::encoders() {
+	static std::vector<RotaryEncoder *> s_encoders;
+	return s_encoders;
+}
+
+RotaryEncoder::RotaryEncoder(uint pinA, uint stepsPerDetent, PIO pio)
+    : d_pio{pio}
+    , d_sm{uint(pio_claim_unused_sm(pio, true))}
+    , d_detents{stepsPerDetent} {
+
+	loadProgram(pio);
+	for (uint pin : {pinA, pinA + 1}) {
+		gpio_init(pin);
+		gpio_pull_up(pin);
+	}
+
+	auto config = pio_get_default_sm_config();
+	sm_config_set_wrap(
+	    &config,
+	    details::QUADRATURE_WRAP_BOTTOM,
+	    details::QUADRATURE_WRAP_TOP
+	);
+	sm_config_set_in_pins(&config, pinA);
+	sm_config_set_in_shift(&config, false, false, 32);
+	sm_config_set_fifo_join(&config, PIO_FIFO_JOIN_RX);
+	pio_sm_init(pio, d_sm, details::QUADRATURE_START, &config);
+
+	// starts from the current levels, with a null count.
+	pio_sm_exec(pio, d_sm, pio_encode_mov(pio_isr, pio_null));
+	pio_sm_exec(pio, d_sm, pio_encode_in(pio_pins, 2));
+	pio_sm_exec(pio, d_sm, pio_encode_mov(pio_osr, pio_isr));
+	pio_sm_exec(pio, d_sm, pio_encode_mov(pio_y, pio_null));
+	pio_sm_set_enabled(pio, d_sm, true);
+
+	encoders().push_back(this);
+}
+
+RotaryEncoder::~RotaryEncoder() {
+	auto &e = encoders();
+	e.erase(std::remove(e.begin(), e.end(), this), e.end());
+
+	pio_sm_set_enabled(d_pio, d_sm, false);
+	pio_sm_unclaim(d_pio, d_sm);
+}
+
+std::optional<RotaryEncoder::Event> RotaryEncoder::Pending() {
+	if (d_pendingEvents.empty()) {
+		return std::nullopt;
+	}
+	Event e;
+	d_pendingEvents.pop(e);
+	return e;
+}
+
+void RotaryEncoder::ScheduleUpdateTask() {
+	Scheduler::Get().Schedule(
+	    PICO_ROTARY_ENCODER_UPDATE_PERIOD_US,
+	    updateAllTask,
+	    {.Start = 0, .Name = "encoders"}
+	);
+}
+
+std::optional<int64_t> RotaryEncoder::updateAllTask(absolute_time_t now) {
+	for (const auto self : encoders()) {
+		self->update(now);
+	}
+	return std::nullopt;
+}
+
+void RotaryEncoder::update(absolute_time_t now) {
+	// the count is pushed every few cycles, the last one in the FIFO is the
+	// newest.
+	for (uint n = pio_sm_get_rx_fifo_level(d_pio, d_sm) + 1; n > 0; --n) {
+		d_count = int32_t(pio_sm_get_blocking(d_pio, d_sm));
+	}
+	auto e = d_detents.Update(d_count, now);
+	if (e.has_value()) {
+		d_pendingEvents.insert(e.value());
+	}
+}
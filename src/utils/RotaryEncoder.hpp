@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: LGPL-3.0+
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <hardware/pio.h>
+#include <pico/types.h>
+
+#include <utils/RingBuffer.hpp>
+
+// Period of the update task turning the counts into events.
+#ifndef PICO_ROTARY_ENCODER_UPDATE_PERIOD_US
+#define PICO_ROTARY_ENCODER_UPDATE_PERIOD_US 10000
+#endif
+
+namespace details {
+// Program decoding quadrature into a count in Y, pushed continuously. It
+// must be loaded at offset 0, as it jumps to the entry of the previous and
+// current levels of the pins in a table of 16 jumps.
+extern const uint16_t QUADRATURE_INSTRUCTIONS[27];
+
+// where the program starts, and its wrap.
+inline constexpr uint QUADRATURE_START       = 19;
+inline constexpr uint QUADRATURE_WRAP_BOTTOM = 17;
+inline constexpr uint QUADRATURE_WRAP_TOP    = 26;
+
+// Turns a count of quadrature steps into detents, scaled up when turning
+// fast.
+class EncoderDetents {
+public:
+	struct Event {
+		// detents turned since the last event, positive when B lags A.
+		int32_t Delta;
+		// Delta multiplied by 2 to 8 from 10 detents per second.
+		int32_t Accelerated;
+		// detents per second since the last event.
+		uint32_t Rate;
+	};
+
+	EncoderDetents(uint stepsPerDetent)
+	    : d_stepsPerDetent{int32_t(stepsPerDetent)} {}
+
+	std::optional<Event> Update(int32_t count, absolute_time_t now);
+
+private:
+	int32_t d_stepsPerDetent;
+	// count of the last detent.
+	int32_t         d_origin = 0;
+	absolute_time_t d_last   = 0;
+};
+} // namespace details
+
+// A rotary encoder with A and B on consecutive GPIOs, decoded by a PIO state
+// machine sampling them at full speed, so no step is lost whatever the
+// load of the CPU. Its count is turned into events by the update task.
+//
+// The program takes 27 of the 32 instructions of a PIO, from offset 0, so
+// the encoders need a PIO of their own: pio1 by default, while LEDStrip and
+// KeyMatrix default to pio0.
+class RotaryEncoder {
+public:
+	typedef details::EncoderDetents::Event Event;
+
+	// Most mechanical encoders go through the 4 steps of a cycle between
+	// two detents.
+	RotaryEncoder(uint pinA, uint stepsPerDetent = 4, PIO pio = pio1);
+	~RotaryEncoder();
+
+	RotaryEncoder(const RotaryEncoder &)            = delete;
+	RotaryEncoder(RotaryEncoder &&)                 = delete;
+	RotaryEncoder &operator=(const RotaryEncoder &) = delete;
+	RotaryEncoder &operator=(RotaryEncoder &&)      = delete;
+
+	std::optional<Event> Pending();
+
+	// Steps counted by the PIO, as of the last update.
+	int32_t Count() const {
+		return d_count;
+	}
+
+	static void ScheduleUpdateTask();
+
+private:
+	static std::optional<int64_t> updateAllTask(absolute_time_t now);
+
+	void update(absolute_time_t now);
+
+	static std::vector<RotaryEncoder *> &encoders();
+
+	PIO  d_pio;
+	uint d_sm;
+
+	int32_t                 d_count = 0;
+	details::EncoderDetents d_detents;
+	RingBuffer<Event, 8>    d_pendingEvents;
+};
@@ -0,0 +1,126 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#include "Telemetry.hpp"
+
+#include <cstring>
+
+#include <pico/stdio.h>
+
+#include <utils/Scheduler.hpp>
+
+namespace details {
+
+size_t COBSEncode(const uint8_t *data, size_t size, uint8_t *out) {
+	size_t  code = 0, written = 1;
+	uint8_t run  = 1;
+	for (size_t i = 0; i < size; ++i) {
+		if (data[i] != 0) {
+			out[written++] = data[i];
+			++run;
+		}
+		if (data[i] == 0 || run == 0xff) {
+			out[code] = run;
+			code      = written++;
+			run       = 1;
+		}
+	}
+	out[code] = run;
+	return written;
+}
+
+} // namespace details
+
+Telemetry::Channel Telemetry::s_channels[2];
+uint32_t           Telemetry::s_sent = 0;
+Telemetry::Sink    Telemetry::s_sink = [](const uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        putchar_raw(data[i]);
+    }
+};
+
+bool Telemetry::push(uint8_t identifier, const void *data, size_t size) {
+	auto  core = get_core_num();
+	auto &ch   = s_channels[core];
+
+	struct __attribute__((packed)) {
+		uint8_t Size;
+		Header  Packet;
+	} prefix = {
+	    .Size = uint8_t(size),
+	    .Packet =
+	        {
+	            .Sequence   = ch.Sequence++,
+	            .Identifier = identifier,
+	            .Core       = uint8_t(core),
+	            .Time_us    = time_us_32(),
+	        },
+	};
+
+	if (ch.Ring.write(&prefix, sizeof(prefix), data, size) == false) {
+		++ch.Dropped;
+		return false;
+	}
+	++ch.Pushed;
+	return true;
+}
+
+bool Telemetry::SendNextPendingRecord() {
+	// COBS adds one byte per 254 bytes, plus the 0x00 delimiters.
+	constexpr static size_t PacketSize = sizeof(Header) + MaxRecordSize + 2;
+	static size_t           next       = 0;
+
+	for (size_t i = 0; i < 2; ++i, next = (next + 1) % 2) {
+		auto   &ring = s_channels[next].Ring;
+		uint8_t size;
+		if (ring.peek(&size, 1) == false) {
+			continue;
+		}
+
+		uint8_t packet[PacketSize];
+		uint8_t encoded[PacketSize + PacketSize / 254 + 3];
+
+		ring.peek(packet, sizeof(Header) + size, 1);
+		ring.consume(1 + sizeof(Header) + size);
+		size += sizeof(Header);
+
+		auto crc       = details::CRC16(packet, size);
+		packet[size++] = crc & 0xff;
+		packet[size++] = crc >> 8;
+
+		// the leading delimiter ends any text written to the same output
+		// since the previous packet, which would corrupt this one.
+		encoded[0]   = 0x00;
+		auto n       = 1 + details::COBSEncode(packet, size, encoded + 1);
+		encoded[n++] = 0x00;
+		s_sink(encoded, n);
+		++s_sent;
+		next = (next + 1) % 2;
+		return true;
+	}
+	return false;
+}
+
+void Telemetry::ScheduleSending() {
+	Scheduler::Get().Schedule(
+	    1000,
+	    []() {
+		    // a budget per run keeps other low priority tasks going.
+		    for (int i = 0; i < 64 && SendNextPendingRecord(); ++i) {
+		    }
+	    },
+	    {.Priority = SCHEDULER_LOW_PRIORITY, .Name = "telemetry/output"}
+	);
+}
+
+void Telemetry::SetSink(Sink &&sink) {
+	s_sink = std::move(sink);
+}
+
+Telemetry::Stats Telemetry::GetStats() {
+	Stats res = {.Pushed = 0, .Dropped = 0, .Sent = s_sent};
+	for (const auto &ch : s_channels) {
+		res.Pushed += ch.Pushed;
+		res.Dropped += ch.Dropped;
+	}
+	return res;
+}
@@ -0,0 +1,102 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+
+extern "C" {
+#include <pico/time.h>
+#include <pico/types.h>
+}
+
+#include <utils/ByteRing.hpp>
+#include <utils/CRC.hpp>
+
+#ifndef PICO_TELEMETRY_BUFFER_SIZE
+#define PICO_TELEMETRY_BUFFER_SIZE 4096
+#endif
+
+// Associates a record type with its identifier on the wire. Record types must
+// be trivially copyable, their layout is what is sent:
+//
+//   struct Attitude {
+//       float Roll, Pitch, Yaw;
+//   };
+//   TELEMETRY_RECORD(Attitude, 1);
+//
+//   Telemetry::Push(Attitude{.Roll = 0.1f, .Pitch = 0.0f, .Yaw = 1.2f});
+template <typename T> struct TelemetryRecord;
+
+#define TELEMETRY_RECORD(Type, Id)                                             \
+	template <> struct TelemetryRecord<Type> {                                 \
+		static constexpr uint8_t ID = Id;                                      \
+	}
+
+namespace details {
+size_t COBSEncode(const uint8_t *data, size_t size, uint8_t *out);
+} // namespace details
+
+// Binary channel for high rate records. Push() only copies the record in a
+// lock-free ring of the calling core. Records are then sent from a scheduled
+// task as COBS encoded packets, each preceded and terminated by a 0x00 byte:
+//
+//   | Header (8 bytes) | record | CRC-16/CCITT of header and record (LE) |
+//
+// Sequence numbers are per core and are incremented even when a record is
+// dropped because the ring is full, so the receiver can detect losses.
+class Telemetry {
+public:
+	static constexpr size_t MaxRecordSize = 240;
+
+	struct Header {
+		uint16_t Sequence;
+		uint8_t  Identifier;
+		uint8_t  Core;
+		uint32_t Time_us;
+	};
+
+	struct Stats {
+		uint32_t Pushed;
+		uint32_t Dropped;
+		uint32_t Sent;
+	};
+
+	typedef std::function<void(const uint8_t *, size_t)> Sink;
+
+	template <typename T> inline static bool Push(const T &record) {
+		static_assert(
+		    std::is_trivially_copyable_v<T>,
+		    "Telemetry records must be trivially copyable"
+		);
+		static_assert(
+		    sizeof(T) <= MaxRecordSize,
+		    "Telemetry record exceeds MaxRecordSize"
+		);
+		return push(TelemetryRecord<T>::ID, &record, sizeof(T));
+	}
+
+	static bool SendNextPendingRecord();
+
+	static void ScheduleSending();
+
+	// Replaces the default output, which writes raw bytes to stdio.
+	static void SetSink(Sink &&sink);
+
+	static Stats GetStats();
+
+private:
+	struct Channel {
+		ByteRing<PICO_TELEMETRY_BUFFER_SIZE> Ring;
+		uint16_t                             Sequence = 0;
+		uint32_t                             Pushed   = 0;
+		uint32_t                             Dropped  = 0;
+	};
+
+	static bool push(uint8_t identifier, const void *data, size_t size);
+
+	static Channel  s_channels[2];
+	static uint32_t s_sent;
+	static Sink     s_sink;
+};
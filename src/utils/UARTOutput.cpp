@@ -0,0 +1,156 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#include "UARTOutput.hpp"
+
+#include <hardware/dma.h>
+#include <hardware/gpio.h>
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+#include <pico/stdio.h>
+#include <pico/stdio/driver.h>
+
+#include <utils/Defer.hpp>
+
+details::TxStream<PICO_UART_OUTPUT_BUFFER_SIZE> UARTOutput::s_stream;
+
+static int          s_channel  = -1;
+static spin_lock_t *s_lock     = nullptr;
+static bool         s_blocking = true;
+
+static void outChars(const char *buf, int len) {
+	UARTOutput::Write(buf, len);
+}
+
+static void outFlush() {
+	UARTOutput::Flush();
+}
+
+static stdio_driver_t s_driver = {
+    .out_chars = outChars,
+    .out_flush = outFlush,
+#if PICO_STDIO_ENABLE_CRLF_SUPPORT
+    .crlf_enabled = PICO_STDIO_DEFAULT_CRLF,
+#endif
+};
+
+void UARTOutput::Init(uart_inst_t *uart, uint txPin, const Options &options) {
+	if (s_channel >= 0) {
+		return;
+	}
+	s_blocking = options.Blocking;
+	s_lock     = spin_lock_instance(spin_lock_claim_unused(true));
+
+	uart_init(uart, options.BaudRate);
+	gpio_set_function(txPin, GPIO_FUNC_UART);
+
+	s_channel   = dma_claim_unused_channel(true);
+	auto config = dma_channel_get_default_config(s_channel);
+	channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+	channel_config_set_read_increment(&config, true);
+	channel_config_set_write_increment(&config, false);
+	channel_config_set_dreq(&config, uart_get_dreq(uart, true));
+	dma_channel_configure(
+	    s_channel,
+	    &config,
+	    &uart_get_hw(uart)->dr,
+	    nullptr,
+	    0,
+	    false
+	);
+
+	irq_add_shared_handler(
+	    DMA_IRQ_1,
+	    onTransferDone,
+	    PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY
+	);
+	dma_channel_set_irq1_enabled(s_channel, true);
+	irq_set_enabled(DMA_IRQ_1, true);
+
+	stdio_set_driver_enabled(&s_driver, true);
+}
+
+// must be called with s_lock held
+void UARTOutput::startNext() {
+	auto [data, size] = s_stream.next();
+	if (size > 0) {
+		dma_channel_transfer_from_buffer_now(s_channel, data, size);
+	}
+}
+
+// poll() on the other core may have completed the transfer, and started the
+// next one, before the lock is taken: the transfer is checked again under
+// it, like poll() does.
+void UARTOutput::onTransferDone() {
+	auto saved = spin_lock_blocking(s_lock);
+	defer {
+		spin_unlock(s_lock, saved);
+	};
+	if (dma_channel_get_irq1_status(s_channel) == false) {
+		return;
+	}
+	dma_channel_acknowledge_irq1(s_channel);
+	if (s_stream.busy() == false || dma_channel_is_busy(s_channel)) {
+		return;
+	}
+	s_stream.complete();
+	startNext();
+}
+
+// Completes the transfer in flight without relying on the interrupt, which
+// may be masked for the caller.
+void UARTOutput::poll() {
+	auto saved = spin_lock_blocking(s_lock);
+	defer {
+		spin_unlock(s_lock, saved);
+	};
+	if (s_stream.busy() == false || dma_channel_is_busy(s_channel)) {
+		return;
+	}
+	dma_channel_acknowledge_irq1(s_channel);
+	s_stream.complete();
+	startNext();
+}
+
+size_t UARTOutput::Write(const char *data, size_t size) {
+	size_t written = 0;
+	while (true) {
+		written += s_stream.write(
+		    reinterpret_cast<const uint8_t *>(data) + written,
+		    s_blocking ? std::min(size - written, s_stream.free())
+		               : size - written
+		);
+
+		auto saved = spin_lock_blocking(s_lock);
+		startNext();
+		spin_unlock(s_lock, saved);
+
+		if (written == size || s_blocking == false) {
+			return written;
+		}
+		poll();
+		tight_loop_contents();
+	}
+}
+
+void UARTOutput::Flush() {
+	while (s_stream.size() > 0) {
+		poll();
+		tight_loop_contents();
+	}
+}
+
+size_t UARTOutput::Pending() {
+	return s_stream.size();
+}
+
+size_t UARTOutput::Free() {
+	return s_stream.free();
+}
+
+size_t UARTOutput::HighWaterMark() {
+	return s_stream.highWaterMark();
+}
+
+size_t UARTOutput::Dropped() {
+	return s_stream.dropped();
+}
@@ -0,0 +1,117 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+extern "C" {
+#include <hardware/uart.h>
+#include <pico/types.h>
+}
+
+#include <utils/ByteRing.hpp>
+
+#ifndef PICO_UART_OUTPUT_BUFFER_SIZE
+#define PICO_UART_OUTPUT_BUFFER_SIZE 4096
+#endif
+
+namespace details {
+// Bookkeeping of a transmit ring drained in contiguous chunks by an
+// asynchronous transfer engine. next() and complete() must be serialized by
+// the caller, write() may run concurrently with them.
+template <size_t N> class TxStream {
+public:
+	// Queues as much of data as fits, returns the number of accepted bytes.
+	inline size_t write(const uint8_t *data, size_t size) {
+		size_t accepted = std::min(size, d_ring.free());
+		d_ring.write(data, accepted);
+		d_highWaterMark = std::max(d_highWaterMark, d_ring.size());
+		d_dropped += size - accepted;
+		return accepted;
+	}
+
+	// Next chunk to transfer, or an empty one when a transfer is already in
+	// flight or there is nothing to send.
+	inline std::pair<const uint8_t *, size_t> next() {
+		if (d_inFlight > 0) {
+			return {nullptr, 0};
+		}
+		auto chunk = d_ring.contiguous();
+		d_inFlight = chunk.second;
+		return chunk;
+	}
+
+	inline void complete() {
+		d_ring.consume(d_inFlight);
+		d_inFlight = 0;
+	}
+
+	inline bool busy() const {
+		return d_inFlight > 0;
+	}
+
+	inline size_t size() const {
+		return d_ring.size();
+	}
+
+	inline size_t free() const {
+		return d_ring.free();
+	}
+
+	inline size_t highWaterMark() const {
+		return d_highWaterMark;
+	}
+
+	inline size_t dropped() const {
+		return d_dropped;
+	}
+
+private:
+	ByteRing<N> d_ring;
+	size_t      d_inFlight      = 0;
+	size_t      d_highWaterMark = 0;
+	size_t      d_dropped       = 0;
+};
+} // namespace details
+
+// Sends stdio output (printf, the Logger, debugf...) to a UART through a
+// transmit ring streamed by DMA, so writers return as soon as their bytes
+// are queued instead of waiting for the UART FIFO. Replaces stdio_uart for
+// that UART: do not initialize both.
+class UARTOutput {
+public:
+	struct Options {
+		uint BaudRate = 115200;
+		// When the ring is full, either wait for the DMA to free some space
+		// or drop the bytes that do not fit.
+		bool Blocking = true;
+	};
+
+	static void Init(uart_inst_t *uart, uint txPin, const Options &options);
+
+	static void Init(uart_inst_t *uart, uint txPin) {
+		Init(uart, txPin, Options{});
+	}
+
+	// Queues bytes for output, returns how many were queued. Calls must not
+	// overlap, which stdio already ensures for printf and friends.
+	static size_t Write(const char *data, size_t size);
+
+	// Waits until all queued bytes were handed to the UART.
+	static void Flush();
+
+	// Backpressure information, in bytes.
+	static size_t Pending();
+	static size_t Free();
+	static size_t HighWaterMark();
+	static size_t Dropped();
+
+private:
+	static void onTransferDone();
+	static void poll();
+	static void startNext();
+
+	static details::TxStream<PICO_UART_OUTPUT_BUFFER_SIZE> s_stream;
+};
@@ -0,0 +1,37 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#include "WS2812.hpp"
+
+#include <utils/LEDAnimation.hpp>
+
+namespace details {
+
+static constexpr auto GAMMA = MakeLEDGamma(255);
+
+WS2812Encoder::WS2812Encoder()
+    : d_brightness{0} {
+	SetBrightness(255 << 8);
+}
+
+void WS2812Encoder::SetBrightness(uint16_t brightness) {
+	if (brightness == d_brightness) {
+		return;
+	}
+	d_brightness = brightness;
+	// a lookup per colour when encoding.
+	for (uint32_t i = 0; i < 256; ++i) {
+		d_levels[i] = LEDLuminance(GAMMA, i * brightness / 255);
+	}
+}
+
+void WS2812Encoder::Encode(const RGB *pixels, size_t count, uint32_t *out)
+    const {
+	for (size_t i = 0; i < count; ++i) {
+		uint32_t g = d_levels[pixels[i].G];
+		uint32_t r = d_levels[pixels[i].R];
+		uint32_t b = d_levels[pixels[i].B];
+		out[i]     = (g << 24) | (r << 16) | (b << 8);
+	}
+}
+
+} // namespace details
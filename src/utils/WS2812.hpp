@@ -0,0 +1,28 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utils/Color.hpp>
+
+namespace details {
+// Encodes pixels into the words shifted out MSB first by the PIO program of
+// LEDStrip: green, red then blue from the most significant byte, the least
+// significant one unused. Colours are scaled by a brightness and gamma
+// corrected with the same model as LED.
+class WS2812Encoder {
+public:
+	WS2812Encoder();
+
+	// brightness is a perceived level in 8.8 fixed point.
+	void SetBrightness(uint16_t brightness);
+
+	void Encode(const RGB *pixels, size_t count, uint32_t *out) const;
+
+private:
+	uint8_t  d_levels[256];
+	uint16_t d_brightness;
+};
+} // namespace details
@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: LGPL-3.0+
+
+#pragma once
+
+#include <cstdarg>
+#include <cstdio>
+
+// Checks of the test programs, printed as they run, with the number of
+// failures returned by main() and printed by ReportChecks().
+
+inline int &CheckFailures() {
+	static int s_failures = 0;
+	return s_failures;
+}
+
+inline static void Checkf(bool ok, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+inline static void Checkf(bool ok, const char *fmt, ...) {
+	printf("%s: ", ok ? "  ok" : "FAIL");
+	va_list args;
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
+	printf("\n");
+	CheckFailures() += ok == false;
+}
+
+inline static int ReportChecks() {
+	printf("%d failure(s)\n", CheckFailures());
+	return CheckFailures();
+}
@@ -0,0 +1,177 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+// Exercises BlobStorage on a simulated flash image: values of various sizes
+// under runtime keys, overwrites, deletions, iteration, and remounts, some of
+// them after a power loss in the middle of a Put() or a Delete().
+#include <cstdio>
+#include <cstring>
+
+#include <pico/stdlib.h>
+
+#include <utils/BlobStorage.hpp>
+#include <utils/FlashDevice.hpp>
+#include <utils/Scheduler.hpp>
+
+#include "Checks.hpp"
+
+static bool holds(BlobStorage &blobs, const char *key, const char *value) {
+	static char data[BlobStorage::MAX_VALUE_SIZE];
+	auto size = blobs.Get(key, data, sizeof(data));
+	return size == strlen(value) && memcmp(data, value, strlen(value)) == 0;
+}
+
+static void basics() {
+	SimulatedFlash     flash(3);
+	details::NVStorage storage(flash);
+	BlobStorage        blobs(storage);
+
+	Checkf(blobs.Put("wifi/ssid", "workshop", 8), "put");
+	Checkf(blobs.Put("wifi/psk", "correct horse", 13), "put another key");
+	Checkf(holds(blobs, "wifi/ssid", "workshop"), "get");
+	Checkf(blobs.Get("wifi", nullptr, 0).has_value() == false, "missing key");
+
+	char prefix[4];
+	Checkf(
+	    blobs.Get("wifi/psk", prefix, sizeof(prefix)) == 13 &&
+	        memcmp(prefix, "corr", 4) == 0,
+	    "partial get returns the full size"
+	);
+
+	Checkf(blobs.Put("wifi/ssid", "lab", 3), "overwrite with another size");
+	Checkf(holds(blobs, "wifi/ssid", "lab"), "get the new value");
+
+	uint16_t calibration[64];
+	for (int i = 0; i < 64; ++i) {
+		calibration[i] = i * 3;
+	}
+	Checkf(
+	    blobs.Put("cal/0", calibration, sizeof(calibration)),
+	    "put a binary value"
+	);
+	Checkf(blobs.Delete("wifi/psk"), "delete");
+	Checkf(blobs.Delete("wifi/psk") == false, "delete twice");
+	Checkf(blobs.Get("wifi/psk", nullptr, 0).has_value() == false, "deleted");
+
+	char tooLong[BlobStorage::MAX_KEY_SIZE + 2];
+	memset(tooLong, 'k', sizeof(tooLong) - 1);
+	tooLong[sizeof(tooLong) - 1] = 0;
+	Checkf(blobs.Put(tooLong, "x", 1) == false, "key too long");
+
+	size_t keys = 0;
+	blobs.ForEach([&keys](const char *key, size_t size) {
+		printf("      %-12s %3d bytes\n", key, size);
+		++keys;
+	});
+	Checkf(keys == 2 && blobs.Size() == 2, "iterate over the keys");
+
+	// FlashStorage objects share the region.
+	uint32_t object = 42;
+	storage.Save(1, &object, sizeof(object));
+
+	details::NVStorage remounted(flash);
+	BlobStorage        reloaded(remounted);
+	Checkf(
+	    holds(reloaded, "wifi/ssid", "lab") && reloaded.Size() == 2 &&
+	        reloaded.Get("wifi/psk", nullptr, 0).has_value() == false,
+	    "remount"
+	);
+}
+
+static void compactions() {
+	SimulatedFlash     flash(2);
+	details::NVStorage storage(flash);
+	BlobStorage        blobs(storage);
+
+	char key[16], value[64];
+	for (int i = 0; i < 500; ++i) {
+		snprintf(key, sizeof(key), "channel/%d", i % 8);
+		snprintf(value, sizeof(value), "gain %d", i);
+		if (blobs.Put(key, value, strlen(value)) == false) {
+			Checkf(false, "put while compacting");
+			return;
+		}
+		// deleted keys stay deleted after their sector is reclaimed.
+		if (i % 8 == 7) {
+			blobs.Put("scratch", value, strlen(value));
+			blobs.Delete("scratch");
+		}
+	}
+
+	details::NVStorage remounted(flash);
+	BlobStorage        reloaded(remounted);
+	bool               ok = reloaded.Size() == 8;
+	ok = ok && reloaded.Get("scratch", nullptr, 0).has_value() == false;
+	for (int i = 492; i < 500; ++i) {
+		snprintf(key, sizeof(key), "channel/%d", i % 8);
+		snprintf(value, sizeof(value), "gain %d", i);
+		ok = ok && holds(reloaded, key, value);
+	}
+	Checkf(ok, "500 puts and deletes over 2 sectors");
+}
+
+// A new key appears with its value or not at all, and a deletion never
+// leaves a key without value.
+static void powerLoss() {
+	size_t operations;
+	{
+		SimulatedFlash     flash(2);
+		details::NVStorage storage(flash);
+		BlobStorage        blobs(storage);
+		blobs.Put("name", "pico", 4);
+		operations = flash.Operations();
+		blobs.Put("serial", "E6614C311B", 10);
+		blobs.Delete("name");
+		operations = flash.Operations() - operations;
+	}
+
+	bool ok = true;
+	for (size_t cut = 0; cut < operations; ++cut) {
+		for (unsigned seed = 0; seed < 4; ++seed) {
+			srand(cut * 4 + seed);
+			SimulatedFlash flash(2);
+			{
+				details::NVStorage storage(flash);
+				BlobStorage        blobs(storage);
+				blobs.Put("name", "pico", 4);
+				flash.CutPowerAt(flash.Operations() + cut);
+				blobs.Put("serial", "E6614C311B", 10);
+				blobs.Delete("name");
+			}
+			flash.PowerOn();
+
+			details::NVStorage storage(flash);
+			BlobStorage        blobs(storage);
+			auto               serial = blobs.Get("serial", nullptr, 0);
+			auto               name   = blobs.Get("name", nullptr, 0);
+			size_t             keys   = 0;
+			blobs.ForEach([&keys](const char *, size_t) { ++keys; });
+			if ((serial.has_value() && serial != 10) ||
+			    (name.has_value() && name != 4) ||
+			    keys != serial.has_value() + name.has_value() ||
+			    blobs.Size() != keys ||
+			    blobs.Put("after", "ok", 2) == false) {
+				printf("      power cut at operation %d, seed %d\n", cut, seed);
+				ok = false;
+			}
+		}
+	}
+	Checkf(ok, "power losses during put and delete");
+}
+
+int main() {
+	stdio_init_all();
+	sleep_ms(2000);
+
+	// modifications lock core 1 out, which must be running.
+	Scheduler::InitWorkLoopOnCore1([]() {});
+
+	printf("BlobStorage\n");
+	basics();
+	compactions();
+	powerLoss();
+	ReportChecks();
+
+	while (true) {
+		tight_loop_contents();
+	}
+}
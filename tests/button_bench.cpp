@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: LGPL-3.0+
+
+// Compares the time spent per update by buttons processed one by one and by
+// a ButtonBank, for 1, 8 and 30 buttons. The buttons are released, which is
+// the common case, then both are fed bouncing presses to count the time spent
+// when all of them are active. The samples are synthetic, so no GPIO is
+// touched and the stdio UART keeps working.
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include <pico/stdlib.h>
+
+#include <utils/Button.hpp>
+#include <utils/ButtonBank.hpp>
+
+static constexpr int ROUNDS = 10000;
+
+// a press of 100ms every second, shifted for each button, with a few bounces
+// when pressed.
+static uint32_t pressed(int round, int nbButtons) {
+	uint32_t res = 0;
+	for (int i = 0; i < nbButtons; ++i) {
+		int t = (round + 7 * i) % 200;
+		if (t < 20 && (t >= 3 || t % 2 == 0)) {
+			res |= 1U << i;
+		}
+	}
+	return res;
+}
+
+static void run(int nbButtons) {
+	uint32_t mask = nbButtons == 32 ? ~0U : (1U << nbButtons) - 1;
+
+	std::vector<std::unique_ptr<Button>> buttons;
+	for (int i = 0; i < nbButtons; ++i) {
+		buttons.push_back(std::make_unique<Button>(i, Button::Mode::EXTERNAL));
+	}
+	ButtonBank bank(mask, ButtonBank::Input::EXTERNAL);
+
+	absolute_time_t now   = 0;
+	uint64_t        start = time_us_64();
+	for (int r = 0; r < ROUNDS; ++r, now += ButtonBank::SAMPLE_PERIOD_us) {
+		for (auto &b : buttons) {
+			b->Process(false, now);
+		}
+	}
+	uint64_t polled_us = time_us_64() - start;
+
+	start = time_us_64();
+	for (int r = 0; r < ROUNDS; ++r, now += ButtonBank::SAMPLE_PERIOD_us) {
+		bank.Process(0, now);
+	}
+	uint64_t bank_us = time_us_64() - start;
+
+	// the samples are computed beforehand, so only the buttons are timed.
+	static uint32_t samples[ROUNDS];
+	for (int r = 0; r < ROUNDS; ++r) {
+		samples[r] = pressed(r, nbButtons);
+	}
+	int             clicks = 0, bankClicks = 0;
+	absolute_time_t from   = now;
+	start                  = time_us_64();
+	for (int r = 0; r < ROUNDS; ++r, now += ButtonBank::SAMPLE_PERIOD_us) {
+		for (int i = 0; i < nbButtons; ++i) {
+			auto &b = *buttons[i];
+			b.Process((samples[r] >> i) & 1, now);
+			for (auto e = b.Pending(); e.has_value(); e = b.Pending()) {
+				clicks += e.value() == Button::Event::CLICK;
+			}
+		}
+	}
+	uint64_t activePolled_us = time_us_64() - start;
+
+	now   = from;
+	start = time_us_64();
+	for (int r = 0; r < ROUNDS; ++r, now += ButtonBank::SAMPLE_PERIOD_us) {
+		bank.Process(samples[r], now);
+		for (auto e = bank.Pending(); e.has_value(); e = bank.Pending()) {
+			bankClicks += e.value().Event == Button::Event::CLICK;
+		}
+	}
+	uint64_t active_us = time_us_64() - start;
+
+	printf(
+	    "buttons:%2d | released: Button %6lluns, ButtonBank %5lluns per round "
+	    "| pressed: Button %6lluns, ButtonBank %5lluns | clicks: %d, %d\n",
+	    nbButtons,
+	    polled_us * 1000 / ROUNDS,
+	    bank_us * 1000 / ROUNDS,
+	    activePolled_us * 1000 / ROUNDS,
+	    active_us * 1000 / ROUNDS,
+	    clicks,
+	    bankClicks
+	);
+}
+
+int main() {
+	stdio_init_all();
+	sleep_ms(2000);
+
+	printf("Button processing over %d rounds\n", ROUNDS);
+	for (int nbButtons : {1, 8, 30}) {
+		run(nbButtons);
+	}
+
+	while (true) {
+		tight_loop_contents();
+	}
+}
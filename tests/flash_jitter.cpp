@@ -0,0 +1,92 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+// Measures how long a 10kHz control loop on core 1 stalls while core 0 saves
+// to the flash: first with the plain multicore lockout, then with the loop
+// kept running from RAM by FlashSafeCore during the lockouts.
+#include <cstdio>
+
+#include <hardware/structs/timer.h>
+#include <pico/stdlib.h>
+
+#include <utils/FlashSafeCore.hpp>
+#include <utils/FlashStorage.hpp>
+#include <utils/Scheduler.hpp>
+
+struct Settings {
+	uint32_t Values[32];
+};
+
+typedef FlashStorage<Settings, 0x200> StoredSettings;
+
+static constexpr uint32_t ControlPeriod_us = 100;
+
+static volatile bool     s_runInRAM = false;
+static volatile uint32_t s_last     = 0;
+static volatile uint32_t s_maxGap   = 0;
+static volatile uint32_t s_steps    = 0;
+
+// Stands for the control loop, it must not touch the flash.
+static void __not_in_flash_func(controlStep)() {
+	uint32_t now = timer_hw->timerawl;
+	uint32_t gap = now - s_last;
+	if (gap < ControlPeriod_us) {
+		return;
+	}
+	if (s_last != 0 && gap > s_maxGap) {
+		s_maxGap = gap;
+	}
+	s_last  = now;
+	s_steps = s_steps + 1;
+}
+
+static void __not_in_flash_func(duringLockout)(void *) {
+	if (s_runInRAM) {
+		controlStep();
+	}
+}
+
+static void measure(const char *mode) {
+	s_maxGap = 0;
+	s_steps  = 0;
+
+	Settings settings = {};
+	auto     start    = get_absolute_time();
+	for (int i = 0; i < 50; ++i) {
+		settings.Values[0] = i;
+		StoredSettings::Save(settings);
+		sleep_ms(5);
+	}
+	auto elapsed = absolute_time_diff_us(start, get_absolute_time());
+
+	printf(
+	    "%-18s | %5lu control steps in %lldms | max gap: %5luus\n",
+	    mode,
+	    s_steps,
+	    elapsed / 1000,
+	    s_maxGap
+	);
+}
+
+int main() {
+	stdio_init_all();
+	sleep_ms(2000);
+
+	Scheduler::InitWorkLoopOnCore1([]() {
+		FlashSafeCore::RunWhileLockedOut(duringLockout, nullptr);
+		Scheduler::Get().Schedule(
+		    ControlPeriod_us / 2,
+		    []() { controlStep(); },
+		    {.Priority = SCHEDULER_HIGH_PRIORITY, .Name = "control"}
+		);
+	});
+	sleep_ms(100);
+
+	printf("Core 1 control loop jitter during 50 flash saves\n");
+	measure("multicore lockout");
+	s_runInRAM = true;
+	measure("RAM functions");
+
+	while (true) {
+		tight_loop_contents();
+	}
+}
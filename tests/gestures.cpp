@@ -0,0 +1,235 @@
+// SPDX-License-Identifier: LGPL-3.0+
+
+// Feeds samples of buttons to ButtonGestures and checks the gestures
+// delivered to its subscribers: clicks beyond three, repeats accelerating
+// while held down, hold thresholds and chords. It then prints the gestures
+// of buttons on GPIOs 2 to 4, the last two making a chord.
+#include <cstdio>
+#include <vector>
+
+#include <pico/stdlib.h>
+
+#include <utils/ButtonGestures.hpp>
+#include <utils/Scheduler.hpp>
+
+#include "Checks.hpp"
+
+struct Received {
+	GestureEvent    Event;
+	absolute_time_t Time;
+};
+
+// samples every ButtonBank::SAMPLE_PERIOD_us, and records the gestures.
+class Bench {
+public:
+	Bench(const GestureConfig &config = {})
+	    : d_gestures{0xf, ButtonBank::Input::EXTERNAL, config} {
+		d_gestures.Subscribe(0xf, [this](const GestureEvent &e) {
+			Events.push_back({.Event = e, .Time = d_now});
+		});
+		d_gestures.AddChord(0b1100);
+	}
+
+	void Hold(uint32_t pressed, uint32_t duration_ms) {
+		for (uint32_t t = 0; t < duration_ms * 1000;
+		     t += ButtonBank::SAMPLE_PERIOD_us) {
+			d_gestures.Process(pressed, d_now);
+			d_gestures.Dispatch();
+			d_now += ButtonBank::SAMPLE_PERIOD_us;
+		}
+	}
+
+	std::vector<GestureEvent> Of(Gesture type) const {
+		std::vector<GestureEvent> res;
+		for (const auto &r : Events) {
+			if (r.Event.Type == type) {
+				res.push_back(r.Event);
+			}
+		}
+		return res;
+	}
+
+	std::vector<Received> Events;
+
+private:
+	ButtonGestures  d_gestures;
+	absolute_time_t d_now = 0;
+};
+
+static void clicks() {
+	Bench b({.MaxClicks = 5});
+	for (int i = 0; i < 4; ++i) {
+		b.Hold(0b1, 60);
+		b.Hold(0, 100);
+	}
+	b.Hold(0, 500);
+	Checkf(
+	    b.Events.size() == 1 && b.Events[0].Event.Type == Gesture::CLICKS &&
+	        b.Events[0].Event.Count == 4 && b.Events[0].Event.Button == 0,
+	    "4 clicks"
+	);
+
+	Bench capped;
+	for (int i = 0; i < 5; ++i) {
+		capped.Hold(0b10, 60);
+		capped.Hold(0, 100);
+	}
+	capped.Hold(0, 500);
+	Checkf(
+	    capped.Events.size() == 1 && capped.Events[0].Event.Count == 3 &&
+	        capped.Events[0].Event.Button == 1,
+	    "clicks capped at MaxClicks"
+	);
+}
+
+static void held() {
+	Bench b;
+	b.Hold(0b1, 3500);
+	b.Hold(0, 100);
+
+	auto repeats = b.Of(Gesture::REPEAT);
+	auto holds   = b.Of(Gesture::HOLD);
+	Checkf(
+	    b.Events.front().Event.Type == Gesture::PRESS_DOWN &&
+	        b.Events.back().Event.Type == Gesture::RELEASE,
+	    "press down, then release"
+	);
+	Checkf(
+	    holds.size() == 2 && holds[0].Count == 0 && holds[1].Count == 1,
+	    "holds of 1s and 3s"
+	);
+
+	// the periods shorten down to RepeatMinPeriod_us.
+	std::vector<int64_t> times;
+	for (const auto &r : b.Events) {
+		if (r.Event.Type == Gesture::REPEAT) {
+			times.push_back(r.Time);
+		}
+	}
+	bool accelerating = times.size() > 3;
+	for (size_t i = 2; accelerating && i < times.size(); ++i) {
+		accelerating = times[i] - times[i - 1] <= times[i - 1] - times[i - 2];
+	}
+	int64_t last = times[times.size() - 1] - times[times.size() - 2];
+	printf(
+	    "%d repeats, the first one after %dms, the last period %dms\n",
+	    int(repeats.size()),
+	    int(times.front() / 1000),
+	    int(last / 1000)
+	);
+	Checkf(accelerating && last <= 45000, "accelerating repeats");
+	Checkf(
+	    repeats.size() == times.size() &&
+	        repeats.back().Count == repeats.size(),
+	    "repeats are counted"
+	);
+}
+
+static void shortPeriods() {
+	// periods decaying to 0 stop at PICO_GESTURE_MIN_REPEAT_PERIOD_US, so
+	// the repeats do not pile up between samples.
+	constexpr int64_t MIN_PERIOD_us = PICO_GESTURE_MIN_REPEAT_PERIOD_US;
+
+	GestureConfig stuck = {
+	    .LongPress_us       = 10 * 1000,
+	    .RepeatDelay_us     = 10 * 1000,
+	    .RepeatPeriod_us    = 0,
+	    .RepeatMinPeriod_us = 0,
+	};
+	GestureConfig decaying      = stuck;
+	decaying.RepeatPeriod_us    = 20 * 1000;
+	decaying.RepeatAcceleration = 128;
+	for (const auto &config : {stuck, decaying}) {
+		Bench b(config);
+		b.Hold(0b1, 200);
+		b.Hold(0, 100);
+
+		std::vector<int64_t> times;
+		for (const auto &r : b.Events) {
+			if (r.Event.Type == Gesture::REPEAT) {
+				times.push_back(r.Time);
+			}
+		}
+		// the repeats due once long pressed come at once, then one per
+		// period at most.
+		bool spaced = times.size() > 10;
+		for (size_t i = 2; spaced && i < times.size(); ++i) {
+			spaced = times[i] - times[i - 1] >= MIN_PERIOD_us;
+		}
+		auto repeats = b.Of(Gesture::REPEAT);
+		Checkf(
+		    spaced && repeats.back().Count == repeats.size() &&
+		        b.Events.back().Event.Type == Gesture::RELEASE,
+		    "%d repeats with periods decaying to 0",
+		    int(times.size())
+		);
+	}
+}
+
+static void chords() {
+	Bench b;
+	// the second button of the chord bounces a little later.
+	b.Hold(0b0100, 10);
+	b.Hold(0b1100, 5);
+	b.Hold(0b0100, 5);
+	b.Hold(0b1100, 600);
+	b.Hold(0, 500);
+	Checkf(
+	    b.Events.size() == 1 && b.Events[0].Event.Type == Gesture::CHORD &&
+	        b.Events[0].Event.Buttons == 0b1100 &&
+	        b.Events[0].Event.Count == 0,
+	    "a chord, without gestures of its own"
+	);
+
+	Bench late;
+	late.Hold(0b0100, 200);
+	late.Hold(0b1100, 100);
+	late.Hold(0, 500);
+	Checkf(
+	    late.Of(Gesture::CHORD).empty() &&
+	        late.Of(Gesture::CLICKS).size() == 1 &&
+	        late.Of(Gesture::PRESS_DOWN).size() == 1,
+	    "buttons pressed apart are not a chord"
+	);
+}
+
+static void subscribers() {
+	ButtonGestures g(0b11, ButtonBank::Input::EXTERNAL);
+	int            first = 0, second = 0;
+	g.Subscribe(0b01, [&first](const GestureEvent &) { ++first; });
+	g.Subscribe(0b10, [&second](const GestureEvent &) { ++second; });
+
+	absolute_time_t now = 0;
+	for (int i = 0; i < 200; ++i, now += ButtonBank::SAMPLE_PERIOD_us) {
+		g.Process(i < 10 ? 0b10 : 0, now);
+	}
+	g.Dispatch();
+	Checkf(first == 0 && second == 1, "subscribers of a button");
+}
+
+int main() {
+	stdio_init_all();
+	sleep_ms(2000);
+
+	printf("ButtonGestures\n");
+	clicks();
+	held();
+	shortPeriods();
+	chords();
+	subscribers();
+	int failures = ReportChecks();
+
+	static ButtonGestures buttons(0b11100);
+	buttons.AddChord(0b11000);
+	buttons.Subscribe(0b11100, [](const GestureEvent &e) {
+		printf(
+		    "gesture %d of buttons 0x%02x, count %d\n",
+		    int(e.Type),
+		    int(e.Buttons),
+		    int(e.Count)
+		);
+	});
+	ButtonGestures::ScheduleUpdateTask();
+	Scheduler::WorkLoop();
+	return failures;
+}
@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: LGPL-3.0+
+
+// Checks the scanning program and the ghost removal of KeyMatrix, then
+// replays scans of a 4x4 keypad through a ButtonBank, without touching the
+// GPIOs. It then scans a 4x4 keypad with its rows on GPIOs 2 to 5 and its
+// columns on GPIOs 6 to 9, printing its events, the scan rate, and the CPU
+// time spent per update.
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+
+#include <pico/stdlib.h>
+
+#include <utils/ButtonBank.hpp>
+#include <utils/KeyMatrix.hpp>
+#include <utils/Scheduler.hpp>
+
+#include "Checks.hpp"
+
+// key of a 4x4 keypad.
+static constexpr uint32_t key(int row, int column) {
+	return 1U << (row * 4 + column);
+}
+
+static void program() {
+	// set pindirs, 1 << r [31] and in pins, 4 for each row.
+	static const uint16_t GOLDEN[] = {
+	    0xff81, 0x4004, 0xff82, 0x4004, 0xff84, 0x4004, 0xff88, 0x4004,
+	};
+	uint16_t out[2 * KeyMatrix::MAX_ROWS];
+	uint     n  = details::KeyMatrixProgram(4, 4, out);
+	bool     ok = n == std::size(GOLDEN);
+	for (uint i = 0; ok && i < n; ++i) {
+		ok = out[i] == GOLDEN[i];
+	}
+	Checkf(ok, "4x4 scanning program");
+
+	details::KeyMatrixProgram(1, 32, out);
+	Checkf(out[1] == 0x4000, "32 columns are read by in pins, 32");
+}
+
+static void ghosts() {
+	uint32_t three = key(0, 0) | key(0, 2) | key(1, 0);
+	uint32_t ghost = three | key(1, 2);
+
+	Checkf(
+	    details::RemoveGhosts(three, 0, 4, 4) == three,
+	    "3 keys of a rectangle are kept"
+	);
+	Checkf(
+	    details::RemoveGhosts(ghost, three, 4, 4) == three,
+	    "the 4th key of a rectangle is a ghost"
+	);
+	Checkf(
+	    details::RemoveGhosts(ghost, 0, 4, 4) == 0,
+	    "new keys of a rectangle are ignored"
+	);
+	Checkf(
+	    details::RemoveGhosts(ghost | key(3, 1), three, 4, 4) ==
+	        (three | key(3, 1)),
+	    "keys outside of a rectangle are kept"
+	);
+	Checkf(
+	    details::RemoveGhosts(key(0, 0) | key(1, 0), three, 4, 4) ==
+	        (key(0, 0) | key(1, 0)),
+	    "releases are kept"
+	);
+}
+
+// scans every SAMPLE_PERIOD_us, with a glitch while pressing, processed like
+// the update task does.
+static void replay() {
+	struct Step {
+		uint32_t Keys;
+		int      Samples;
+	};
+
+	static const Step STEPS[] = {
+	    {.Keys = 0, .Samples = 10},
+	    {.Keys = key(2, 1), .Samples = 1},
+	    {.Keys = 0, .Samples = 1},
+	    {.Keys = key(2, 1), .Samples = 10},
+	    {.Keys = 0, .Samples = 100},
+	    // a ghost while a key is held down for long.
+	    {.Keys = key(0, 0), .Samples = 10},
+	    {.Keys = key(0, 0) | key(0, 2) | key(1, 0) | key(1, 2), .Samples = 10},
+	    {.Keys = key(0, 0), .Samples = 60},
+	    {.Keys = 0, .Samples = 100},
+	};
+
+	ButtonBank      bank(~0U >> 16, ButtonBank::Input::EXTERNAL);
+	uint32_t        keys = 0;
+	absolute_time_t now  = 0;
+
+	ButtonBank::PinEvent events[8];
+	int                  n = 0;
+	for (const auto &s : STEPS) {
+		for (int i = 0; i < s.Samples; ++i) {
+			keys = details::RemoveGhosts(s.Keys, keys, 4, 4);
+			bank.Process(keys, now);
+			now += ButtonBank::SAMPLE_PERIOD_us;
+			for (auto e = bank.Pending(); e.has_value(); e = bank.Pending()) {
+				if (n < int(std::size(events))) {
+					events[n] = e.value();
+				}
+				++n;
+			}
+		}
+	}
+
+	Checkf(
+	    n == 3 && events[0].Pin == 9 &&
+	        events[0].Event == Button::Event::CLICK &&
+	        events[1].Pin == 0 &&
+	        events[1].Event == Button::Event::PRESS_DOWN &&
+	        events[2].Pin == 0 && events[2].Event == Button::Event::RELEASE,
+	    "replayed keypad events"
+	);
+}
+
+int main() {
+	stdio_init_all();
+	sleep_ms(2000);
+
+	printf("KeyMatrix\n");
+	program();
+	ghosts();
+	replay();
+	int failures = ReportChecks();
+
+	static KeyMatrix keypad(2, 4, 6, 4);
+	KeyMatrix::ScheduleUpdateTask();
+
+	Scheduler::Get().Schedule(20000, []() {
+		for (auto e = keypad.Pending(); e.has_value(); e = keypad.Pending()) {
+			printf("key %2d event %d\n", e->Pin, int(e->Event));
+		}
+	});
+
+	Scheduler::Get().Schedule(
+	    5000000,
+	    []() {
+		    static uint64_t lastScans = 0;
+		    uint64_t        scans     = keypad.Scans();
+		    printf(
+		        "scans: %lluHz | update: %lluns mean\n",
+		        (scans - lastScans) / 5,
+		        keypad.Busy_us() * 1000 /
+		            std::max<uint32_t>(keypad.Updates(), 1)
+		    );
+		    lastScans = scans;
+	    },
+	    {.Start = 5000000}
+	);
+	Scheduler::WorkLoop();
+	return failures;
+}
@@ -3,6 +3,26 @@
 
 #include <pico.h>
 
+// the primary and secondary hues.
+static_assert(ToRGB({.H = 0, .S = 255, .V = 200}).R == 200);
+static_assert(ToRGB({.H = 60, .S = 255, .V = 200}).G == 200);
+static_assert(ToRGB({.H = 120, .S = 255, .V = 200}).B == 0);
+static_assert(ToRGB({.H = 240, .S = 255, .V = 200}).B == 200);
+static_assert(ToRGB({.H = 300, .S = 255, .V = 200}).G == 0);
+static_assert(ToRGB({.H = 480, .S = 0, .V = 10}).G == 10);
+static_assert(Mix({0, 100, 255}, {255, 50, 0}, 255).R == 255);
+
+// fades to half the brightness, then stays there.
+static constexpr LEDKeyframe FADE_FRAMES[] = {
+    {.Level = 128, .Duration_ms = 2000, .Easing = LEDEasing::IN_OUT},
+};
+
+static constexpr LEDAnimation FADE = MakeLEDAnimation(FADE_FRAMES);
+
+// three heartbeats before the fade.
+static constexpr LEDAnimation HEARTBEATS =
+    MakeLEDAnimation(LEDPatterns::HEARTBEAT_FRAMES, 3, &FADE);
+
 int main() {
 
 	LED::ScheduleUpdateTask();
@@ -10,5 +30,28 @@ int main() {
 	LED dflt{PICO_DEFAULT_LED_PIN};
 
 	dflt.Set(255, 2 * 1000 * 1000);
+
+	// cycles through the modes of the LED.
+	Scheduler::Get().Schedule(
+	    8 * 1000 * 1000,
+	    [&dflt]() {
+		    static int mode = 0;
+		    switch (mode++ % 4) {
+		    case 0:
+			    dflt.Play(HEARTBEATS);
+			    break;
+		    case 1:
+			    dflt.Play(LEDPatterns::SOS);
+			    break;
+		    case 2:
+			    dflt.Blink(3);
+			    break;
+		    default:
+			    dflt.Set(255, 2 * 1000 * 1000);
+		    }
+	    },
+	    {.Start = 8 * 1000 * 1000}
+	);
+
 	Scheduler::Get().WorkLoop();
 }
@@ -6,6 +6,8 @@
 int main() {
 	stdio_init_all();
 
+	Logger::PrintRecovered();
+
 	Scheduler::InitWorkLoopOnCore1(Logger::ScheduleLogFormatting);
 
 	Scheduler::Get().Schedule(1000 * 1000, []() {
@@ -14,7 +16,25 @@ int main() {
 	});
 
 	Scheduler::Get().Schedule(2000000, []() { Warnf("A warning"); });
+
+	// a flapping input during 3s, most of it should be collapsed.
+	Scheduler::Get().Schedule(
+	    1000,
+	    [](absolute_time_t now) -> std::optional<int64_t> {
+		    if (now < 5 * 1000 * 1000 || now > 8 * 1000 * 1000) {
+			    return std::nullopt;
+		    }
+		    WarnfLimited("input flapping");
+		    WarnfLimited("input state: %d", int(now / 1000) % 2);
+		    return std::nullopt;
+	    },
+	    {.Name = "flapping"}
+	);
 	Infof("starting logging");
 
+	Scheduler::Get().After(30 * 1000 * 1000, []() {
+		Fatalf("panicking to test message recovery");
+	});
+
 	Scheduler::Get().WorkLoop();
 }
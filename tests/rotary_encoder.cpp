@@ -0,0 +1,235 @@
+// SPDX-License-Identifier: LGPL-3.0+
+
+// Replays A/B waveforms through a model of the PIO running the quadrature
+// program of RotaryEncoder, one instruction per cycle, and checks the count
+// it pushes: bouncing contacts turned back and forth, then steps shortened
+// down to the fastest rate the program keeps up with. The detents and their
+// acceleration are checked from counts. It then prints the events of an
+// encoder on GPIOs 10 and 11.
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <pico/stdlib.h>
+
+#include <utils/RotaryEncoder.hpp>
+#include <utils/Scheduler.hpp>
+
+#include "Checks.hpp"
+
+// Executes the instructions of the program, as a state machine running at
+// the system clock and started like RotaryEncoder does.
+class PIOModel {
+public:
+	PIOModel(uint8_t levels)
+	    : d_osr{levels} {}
+
+	void Cycle(uint8_t levels) {
+		uint16_t i    = details::QUADRATURE_INSTRUCTIONS[d_pc];
+		uint     next = d_pc == details::QUADRATURE_WRAP_TOP
+		                    ? details::QUADRATURE_WRAP_BOTTOM
+		                    : d_pc + 1;
+		switch (i >> 13) {
+		case 0: { // jmp, always or y--
+			bool jump = true;
+			if (((i >> 5) & 7) == 4) {
+				jump = d_y-- != 0;
+			}
+			if (jump) {
+				next = i & 0x1f;
+			}
+			break;
+		}
+		case 2: { // in, from the pins or osr
+			uint32_t n = i & 0x1f;
+			uint32_t v = ((i >> 5) & 7) == 0 ? levels : d_osr;
+			d_isr      = d_isr << n | (v & ((1U << n) - 1));
+			break;
+		}
+		case 4: // push noblock
+			d_pushed = d_isr;
+			d_isr    = 0;
+			break;
+		case 5: { // mov, from y, null, isr or osr
+			uint32_t v = 0;
+			switch (i & 7) {
+			case 2:
+				v = d_y;
+				break;
+			case 6:
+				v = d_isr;
+				break;
+			case 7:
+				v = d_osr;
+				break;
+			}
+			if (((i >> 3) & 3) == 1) {
+				v = ~v;
+			}
+			switch ((i >> 5) & 7) {
+			case 2:
+				d_y = v;
+				break;
+			case 5:
+				next = v & 0x1f;
+				break;
+			case 6:
+				d_isr = v;
+				break;
+			case 7:
+				d_osr = v;
+				break;
+			}
+			break;
+		}
+		}
+		d_pc = next;
+	}
+
+	int32_t Count() const {
+		return int32_t(d_pushed);
+	}
+
+private:
+	uint     d_pc  = details::QUADRATURE_START;
+	uint32_t d_isr = 0, d_osr, d_y = 0, d_pushed = 0;
+};
+
+// levels B << 1 | A held for some cycles.
+struct Segment {
+	uint8_t  Levels;
+	uint32_t Cycles;
+};
+
+static constexpr uint8_t FORWARD[4] = {0b00, 0b01, 0b11, 0b10};
+
+// steps forward when positive, each one held for the given cycles. Contacts
+// bounce for a few cycles at each edge when bounces is not null.
+static void turn(
+    std::vector<Segment> &waveform,
+    uint                 &phase,
+    int                   steps,
+    uint32_t              cycles,
+    int                   bounces
+) {
+	for (int i = 0; i < std::abs(steps); ++i) {
+		uint8_t from = FORWARD[phase];
+		phase        = (phase + (steps > 0 ? 1 : 3)) % 4;
+		uint8_t to   = FORWARD[phase];
+		for (int b = 0; b < bounces; ++b) {
+			waveform.push_back({.Levels = to, .Cycles = 1U + b % 3});
+			waveform.push_back({.Levels = from, .Cycles = 2});
+		}
+		waveform.push_back({.Levels = to, .Cycles = cycles});
+	}
+}
+
+static int32_t replay(const std::vector<Segment> &waveform) {
+	PIOModel pio(waveform.front().Levels);
+	for (const auto &s : waveform) {
+		for (uint32_t c = 0; c < s.Cycles; ++c) {
+			pio.Cycle(s.Levels);
+		}
+	}
+	// the last steps have their count pushed.
+	for (int c = 0; c < 32; ++c) {
+		pio.Cycle(waveform.back().Levels);
+	}
+	return pio.Count();
+}
+
+static void waveforms() {
+	std::vector<Segment> w;
+	uint                 phase = 0;
+	w.push_back({.Levels = 0, .Cycles = 100});
+	turn(w, phase, 12, 5000, 4);
+	turn(w, phase, -3, 5000, 4);
+	turn(w, phase, -30, 2000, 2);
+	turn(w, phase, 5, 8000, 6);
+	Checkf(replay(w) == 12 - 3 - 30 + 5, "bouncing contacts back and forth");
+
+	w     = {{.Levels = 0b10, .Cycles = 100}};
+	phase = 3;
+	turn(w, phase, 7, 100, 0);
+	Checkf(replay(w) == 7, "starting between detents");
+
+	// the longest path from one sample of the pins to the next one.
+	uint32_t fastest = 0;
+	for (uint32_t cycles = 40; cycles > 0; --cycles) {
+		w     = {{.Levels = 0, .Cycles = 100}};
+		phase = 0;
+		turn(w, phase, 1000, cycles, 0);
+		turn(w, phase, -1500, cycles, 0);
+		if (replay(w) != -500) {
+			break;
+		}
+		fastest = cycles;
+	}
+	printf(
+	    "no step lost down to %d cycles per step, %d steps/s at %dMHz\n",
+	    int(fastest),
+	    int(SYS_CLK_HZ / fastest),
+	    int(SYS_CLK_HZ / 1000000)
+	);
+	Checkf(fastest > 0 && fastest <= 11, "steps of 11 cycles");
+}
+
+static void detents() {
+	details::EncoderDetents d(4);
+
+	Checkf(d.Update(3, 100000).has_value() == false, "between detents");
+	auto e = d.Update(4, 200000);
+	Checkf(
+	    e.has_value() && e->Delta == 1 && e->Accelerated == 1 && e->Rate == 5,
+	    "a slow detent"
+	);
+	e = d.Update(-4, 600000);
+	Checkf(
+	    e.has_value() && e->Delta == -2 && e->Accelerated == -2,
+	    "2 detents back"
+	);
+	e = d.Update(-12, 640000);
+	Checkf(
+	    e.has_value() && e->Delta == -2 && e->Accelerated == -16 &&
+	        e->Rate == 50,
+	    "fast detents are accelerated"
+	);
+	e = d.Update(-16, 720000);
+	Checkf(
+	    e.has_value() && e->Accelerated == -2 && e->Rate == 12,
+	    "medium detents"
+	);
+
+	details::EncoderDetents w(4);
+	w.Update(INT32_MAX - 3, 0);
+	e = w.Update(INT32_MIN + 4, 1000000);
+	Checkf(e.has_value() && e->Delta == 2, "count wrapping around");
+}
+
+int main() {
+	stdio_init_all();
+	sleep_ms(2000);
+
+	printf("RotaryEncoder\n");
+	waveforms();
+	detents();
+	int failures = ReportChecks();
+
+	static RotaryEncoder encoder(10);
+	RotaryEncoder::ScheduleUpdateTask();
+
+	Scheduler::Get().Schedule(20000, []() {
+		for (auto e = encoder.Pending(); e.has_value();
+		     e      = encoder.Pending()) {
+			printf(
+			    "delta: %3d accelerated: %4d rate: %3d/s count: %d\n",
+			    int(e->Delta),
+			    int(e->Accelerated),
+			    int(e->Rate),
+			    int(encoder.Count())
+			);
+		}
+	});
+	Scheduler::WorkLoop();
+	return failures;
+}
@@ -0,0 +1,474 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+// Benchmarks NVStorage on a simulated flash image in RAM: the region is only
+// scanned once when mounted, then loads and saves read a constant amount of
+// flash whatever the number of stored objects. Also reports how evenly the
+// sectors are erased, how many saves fit between erases, how zero-copy views
+// get invalidated, how saves are split for the write-behind task, what
+// saving objects together in a transaction costs, and how compression
+// performs on typical data. Finally checks that saves racing the writer on
+// the other core never leave a stale value stored.
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <pico/stdlib.h>
+#include <pico/time.h>
+
+#include <utils/Compression.hpp>
+#include <utils/FlashDevice.hpp>
+#include <utils/FlashStorage.hpp>
+#include <utils/Scheduler.hpp>
+
+#include "Checks.hpp"
+
+struct Settings {
+	uint32_t Values[16];
+};
+
+static void benchmark(size_t nbSectors, size_t nbObjects) {
+	SimulatedFlash       flash(nbSectors);
+	details::NVStorage   storage(flash);
+	constexpr static int Rounds = 50;
+
+	Settings settings = {};
+	for (size_t i = 0; i < nbObjects; ++i) {
+		settings.Values[0] = i;
+		storage.Save(i, &settings, sizeof(Settings));
+	}
+
+	// a fresh instance mounts the existing image.
+	details::NVStorage mounted(flash);
+	flash.ResetCounters();
+	mounted.Mount();
+	size_t mountRead = flash.BytesRead();
+
+	flash.ResetCounters();
+	auto start = get_absolute_time();
+	for (int r = 0; r < Rounds; ++r) {
+		mounted.Load(r % nbObjects, &settings, sizeof(Settings));
+	}
+	auto   loadTime = absolute_time_diff_us(start, get_absolute_time());
+	size_t loadRead = flash.BytesRead();
+
+	flash.ResetCounters();
+	start = get_absolute_time();
+	for (int r = 0; r < Rounds; ++r) {
+		settings.Values[1] = r;
+		mounted.Save(r % nbObjects, &settings, sizeof(Settings));
+	}
+	auto   saveTime = absolute_time_diff_us(start, get_absolute_time());
+	size_t saveRead = flash.BytesRead();
+
+	printf(
+	    "sectors:%2d objects:%3d | mount read:%5dB | load: %4dB %5lldus | "
+	    "save: %5dB %5lldus\n",
+	    nbSectors,
+	    nbObjects,
+	    mountRead,
+	    loadRead / Rounds,
+	    loadTime / Rounds,
+	    saveRead / Rounds,
+	    saveTime / Rounds
+	);
+}
+
+static void wear(size_t nbSectors) {
+	SimulatedFlash     flash(nbSectors);
+	details::NVStorage storage(flash);
+
+	Settings settings = {};
+	for (int i = 0; i < 1000; ++i) {
+		settings.Values[0] = i;
+		storage.Save(i % 5, &settings, sizeof(Settings));
+	}
+
+	printf("sectors:%2d |", nbSectors);
+	for (size_t i = 0; i < storage.Sectors(); ++i) {
+		printf(" %3lu", storage.EraseCount(i));
+	}
+	printf("\n");
+}
+
+// Saves split in lockout windows of PICO_NV_STORAGE_MAX_LOCKOUT_US, as done
+// by the write-behind task.
+static void lockouts(size_t nbSectors) {
+	SimulatedFlash     flash(nbSectors);
+	details::NVStorage storage(flash);
+	constexpr static int Saves = 200;
+
+	Settings settings = {};
+	size_t   windows = 0, maxOperations = 0;
+	for (int i = 0; i < Saves; ++i) {
+		settings.Values[0] = i;
+		details::NVStorage::Progress res;
+		do {
+			auto operations = flash.Operations();
+			res             = storage.SaveSteps(
+			    i % 5,
+			    &settings,
+			    sizeof(Settings),
+			    PICO_NV_STORAGE_MAX_LOCKOUT_US
+			);
+			maxOperations =
+			    std::max(maxOperations, flash.Operations() - operations);
+			++windows;
+		} while (res == details::NVStorage::Progress::PENDING);
+	}
+
+	printf(
+	    "sectors:%2d | lockouts per save: %d.%02d | max flash operations per "
+	    "lockout: %d\n",
+	    nbSectors,
+	    windows / Saves,
+	    (windows * 100 / Saves) % 100,
+	    maxOperations
+	);
+}
+
+// Saves of small objects per sector erase, now that records are packed,
+// against a whole page per save.
+static void savesPerErase(size_t size) {
+	SimulatedFlash       flash(4);
+	details::NVStorage   storage(flash);
+	constexpr static int Saves = 2000;
+
+	uint8_t data[FLASH_PAGE_SIZE] = {};
+	for (int i = 0; i < Saves; ++i) {
+		data[0] = i / 4;
+		data[1] = i / 4 / 256;
+		storage.Save(i % 4, data, size);
+	}
+
+	uint32_t erases = 0;
+	for (size_t i = 0; i < storage.Sectors(); ++i) {
+		erases += storage.EraseCount(i);
+	}
+	typedef details::NVStorage NV;
+	size_t slots = NV::SlotsFor(size);
+	size_t pages = (slots * NV::SLOT_SIZE + FLASH_PAGE_SIZE - 1) /
+	               FLASH_PAGE_SIZE;
+	printf(
+	    "size:%4dB | saves per erase: %4lu | saves per sector: %3d packed, "
+	    "%2d with a page per save\n",
+	    size,
+	    Saves / erases,
+	    (NV::SLOTS_PER_SECTOR - NV::FIRST_SLOT) / slots,
+	    (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE - 1) / pages
+	);
+}
+
+// Zero-copy views of a multi-page table: no flash read through the device,
+// and invalidated by a save of the table or by a compaction moving it.
+static void views() {
+	struct Table {
+		uint32_t Values[256];
+	};
+	SimulatedFlash     flash(2);
+	details::NVStorage storage(flash);
+
+	Table    table = {};
+	Settings other = {};
+	for (int i = 0; i < 256; ++i) {
+		table.Values[i] = i * i;
+	}
+	storage.Save(1, &table, sizeof(Table));
+
+	flash.ResetCounters();
+	details::FlashView<Table> view(storage, 1);
+	uint32_t                  sum = 0;
+	for (auto v : view->Values) {
+		sum += v;
+	}
+	printf(
+	    "view: sum %lu, read through the device: %dB, valid: %d\n",
+	    sum,
+	    flash.BytesRead(),
+	    view.Valid()
+	);
+
+	storage.Save(2, &other, sizeof(Settings));
+	printf("after saving another object, valid: %d\n", view.Valid());
+
+	table.Values[0] = 42;
+	storage.Save(1, &table, sizeof(Table));
+	printf("after saving the table, valid: %d\n", view.Valid());
+
+	view = details::FlashView<Table>(storage, 1);
+	for (int i = 0; view.Valid() && i < 100; ++i) {
+		other.Values[0] = i + 1;
+		storage.Save(2, &other, sizeof(Settings));
+	}
+	printf(
+	    "after a compaction, valid: %d, new view: %lu\n",
+	    view.Valid(),
+	    details::FlashView<Table>(storage, 1)->Values[0]
+	);
+}
+
+// Flash operations to save nbObjects small objects, one by one with a
+// lockout each, or in a single transaction.
+static void transactions(size_t nbObjects) {
+	constexpr static int Rounds = 100;
+	size_t               operations[2];
+	for (int together = 0; together < 2; ++together) {
+		SimulatedFlash     flash(4);
+		details::NVStorage storage(flash);
+		uint32_t           values[PICO_NV_STORAGE_MAX_TRANSACTION];
+		details::NVStorage::Entry entries[PICO_NV_STORAGE_MAX_TRANSACTION];
+		for (size_t i = 0; i < nbObjects; ++i) {
+			entries[i] = {
+			    .UUID   = uint16_t(i),
+			    .Object = &values[i],
+			    .Size   = sizeof(uint32_t),
+			};
+		}
+		for (int round = 0; round < Rounds; ++round) {
+			for (size_t i = 0; i < nbObjects; ++i) {
+				values[i] = round * nbObjects + i;
+				if (together == 0) {
+					storage.Save(i, &values[i], sizeof(uint32_t));
+				}
+			}
+			if (together == 1) {
+				storage.SaveAll(entries, nbObjects);
+			}
+		}
+		operations[together] = flash.Operations();
+	}
+
+	printf(
+	    "objects:%d | one by one: %d.%02d flash operations, %d lockouts | "
+	    "transaction: %d.%02d flash operations, 1 lockout\n",
+	    nbObjects,
+	    operations[0] / Rounds,
+	    operations[0] % Rounds,
+	    nbObjects,
+	    operations[1] / Rounds,
+	    operations[1] % Rounds
+	);
+}
+
+// Stored size, encoding and decoding times of data with a codec, and saves
+// of the data with a changing first byte per erase, compared to raw saves.
+template <typename Codec>
+static void compression(const char *name, uint8_t *data, size_t size) {
+	constexpr static int Runs  = 20;
+	constexpr static int Saves = 500;
+
+	// static, since the default stack of core 0 is only 2 KiB.
+	static uint8_t encoded[sizeof(details::EncodedHeader) + 1024];
+	static uint8_t decoded[1024];
+	size_t         stored = 0;
+	auto           start  = get_absolute_time();
+	for (int i = 0; i < Runs; ++i) {
+		stored = details::Encode(Codec::Encode, Codec::ID, data, size, encoded);
+	}
+	auto encode_us = absolute_time_diff_us(start, get_absolute_time()) / Runs;
+	start          = get_absolute_time();
+	bool ok        = true;
+	for (int i = 0; i < Runs; ++i) {
+		ok = ok && details::Decode(encoded, stored, decoded, size);
+	}
+	auto decode_us = absolute_time_diff_us(start, get_absolute_time()) / Runs;
+	ok             = ok && memcmp(data, decoded, size) == 0;
+
+	uint32_t erases[2] = {0, 0};
+	for (int compressed = 0; compressed < 2; ++compressed) {
+		SimulatedFlash     flash(4);
+		details::NVStorage storage(flash);
+		for (int i = 0; i < Saves; ++i) {
+			data[0] = i;
+			if (compressed) {
+				stored = details::Encode(
+				    Codec::Encode,
+				    Codec::ID,
+				    data,
+				    size,
+				    encoded
+				);
+				storage.Save(1, encoded, stored);
+			} else {
+				storage.Save(1, data, size);
+			}
+		}
+		for (size_t i = 0; i < storage.Sectors(); ++i) {
+			erases[compressed] += storage.EraseCount(i);
+		}
+	}
+
+	printf(
+	    "%-15s %-3s | %4dB -> %4dB (%3d%%) | encode: %5lldus decode: %4lldus "
+	    "| saves per erase: %3lu -> %3lu%s\n",
+	    name,
+	    Codec::ID == RLECompression::ID ? "RLE" : "LZ",
+	    size,
+	    stored,
+	    stored * 100 / size,
+	    encode_us,
+	    decode_us,
+	    Saves / std::max<uint32_t>(erases[0], 1),
+	    Saves / std::max<uint32_t>(erases[1], 1),
+	    ok ? "" : " | DECODING FAILED"
+	);
+}
+
+// Representative data: a gamma lookup table, a history with a few recent
+// events, sparse settings, and noise, which is stored as is.
+static void compressions() {
+	static uint8_t data[1024];
+
+	auto table = reinterpret_cast<uint16_t *>(data);
+	for (int i = 0; i < 256; ++i) {
+		table[i] = uint16_t(std::pow(i / 255.0f, 2.2f) * 4095);
+	}
+	compression<RLECompression>("gamma table", data, 512);
+	compression<LZCompression>("gamma table", data, 512);
+
+	struct Event {
+		uint32_t Time_us;
+		uint16_t Code;
+		uint16_t Value;
+	};
+	auto events = reinterpret_cast<Event *>(data);
+	memset(data, 0, sizeof(data));
+	for (int i = 0; i < 20; ++i) {
+		events[i] = {
+		    .Time_us = 1000000u + i * 15000,
+		    .Code    = uint16_t(i % 3),
+		    .Value   = uint16_t(i * 7),
+		};
+	}
+	compression<RLECompression>("event history", data, sizeof(data));
+	compression<LZCompression>("event history", data, sizeof(data));
+
+	auto values = reinterpret_cast<uint32_t *>(data);
+	memset(data, 0, sizeof(data));
+	for (int i = 0; i < 256; i += 17) {
+		values[i] = 1000 + i;
+	}
+	compression<RLECompression>("sparse settings", data, sizeof(data));
+	compression<LZCompression>("sparse settings", data, sizeof(data));
+
+	for (auto &b : data) {
+		b = rand();
+	}
+	compression<RLECompression>("noise", data, 256);
+	compression<LZCompression>("noise", data, 256);
+}
+
+typedef FlashStorage<Settings, 0x100> StoredSettings;
+
+// Bursts of SaveAsync() on the board flash, coalesced by the writer.
+static void writeBehind() {
+	Settings settings = {};
+	for (int burst = 0; burst < 10; ++burst) {
+		for (int i = 0; i < 10; ++i) {
+			settings.Values[0] = burst * 10 + i;
+			StoredSettings::SaveAsync(settings);
+		}
+		FlashStorageWriter::Flush();
+	}
+
+	auto stats = FlashStorageWriter::GetStats();
+	printf(
+	    "staged:%lu coalesced:%lu written:%lu unchanged:%lu failed:%lu | "
+	    "latency mean:%luus max:%luus | max lockout:%luus\n",
+	    stats.Staged,
+	    stats.Coalesced,
+	    stats.Written,
+	    stats.Unchanged,
+	    stats.Failed,
+	    stats.MeanLatency_us,
+	    stats.MaxLatency_us,
+	    stats.MaxLockout_us
+	);
+}
+
+// Core 1 writes the staged values while core 0 saves the same object
+// synchronously right after staging it. The value saved last must be the
+// one stored, even when core 1 picked the staged one before the Save().
+static std::atomic<bool> s_racing{false};
+
+static void writeRace() {
+	constexpr int Rounds = 200;
+
+	Settings settings = {};
+	int      stale    = 0;
+	s_racing          = true;
+	for (int i = 0; i < Rounds; ++i) {
+		settings.Values[0] = 2 * i;
+		StoredSettings::SaveAsync(settings);
+		busy_wait_us(rand() % 100);
+		settings.Values[0] = 2 * i + 1;
+		StoredSettings::Save(settings);
+		// a write of core 1 in progress ends within a lockout.
+		sleep_us(2 * PICO_NV_STORAGE_MAX_LOCKOUT_US);
+
+		Settings stored;
+		StoredSettings::Load(stored);
+		stale += stored.Values[0] != settings.Values[0];
+	}
+	s_racing = false;
+	Checkf(stale == 0, "%d rounds, %d stale values stored", Rounds, stale);
+}
+
+int main() {
+	stdio_init_all();
+	sleep_ms(2000);
+
+	printf("NVStorage benchmark, per operation averages\n");
+	for (size_t nbSectors : {2, 4, 16}) {
+		for (size_t nbObjects : {1, 4, 8}) {
+			benchmark(nbSectors, nbObjects);
+		}
+	}
+
+	printf("Erase counts per sector after 1000 saves\n");
+	for (size_t nbSectors : {2, 4, 8}) {
+		wear(nbSectors);
+	}
+
+	printf("Saves per sector erase\n");
+	for (size_t size : {2, 4, 16, 64, 200, 1000}) {
+		savesPerErase(size);
+	}
+
+	printf("Zero-copy views\n");
+	views();
+
+	printf("Lockouts of saves split by the write-behind task\n");
+	for (size_t nbSectors : {2, 4, 8}) {
+		lockouts(nbSectors);
+	}
+
+	printf("Saves of several objects, per round\n");
+	for (size_t nbObjects : {2, 4, 8}) {
+		transactions(nbObjects);
+	}
+
+	printf("Compression of typical data\n");
+	compressions();
+
+	// saves to the board flash lock core 1 out, which must be running. It
+	// only writes staged values during writeRace().
+	Scheduler::InitWorkLoopOnCore1([]() {
+		Scheduler::Get().Schedule(20, []() {
+			if (s_racing) {
+				FlashStorageWriter::WriteNext();
+			}
+		});
+	});
+	printf("Write-behind of 10 bursts of 10 saves\n");
+	writeBehind();
+
+	printf("Saves racing the writer on core 1\n");
+	writeRace();
+
+	while (true) {
+		tight_loop_contents();
+	}
+}
@@ -0,0 +1,250 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+// Power loss harness for NVStorage: replays the same sequence of saves on a
+// simulated flash, cutting the power at every program and erase in turn,
+// then checks after a remount that each object holds either its last saved
+// value or the one being saved, and that the storage keeps working. Objects
+// saved together in transactions must all hold the same value.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <pico/stdlib.h>
+
+#include <utils/FlashDevice.hpp>
+#include <utils/FlashStorage.hpp>
+
+struct Object {
+	uint16_t UUID;
+	size_t   Size;
+};
+
+// small ones share pages, large ones span several.
+static constexpr Object Objects[] = {
+    {.UUID = 1, .Size = 4},
+    {.UUID = 2, .Size = 40},
+    {.UUID = 3, .Size = 300},
+    {.UUID = 4, .Size = 600},
+};
+
+// only ever saved together, with the same value.
+static constexpr Object Together[] = {
+    {.UUID = 5, .Size = 8},
+    {.UUID = 6, .Size = 100},
+};
+
+static constexpr size_t NbObjects  = sizeof(Objects) / sizeof(Object);
+static constexpr size_t NbTogether = sizeof(Together) / sizeof(Object);
+static constexpr int    NbSaves   = 40;
+
+// the buffers live on the small stack of core 0.
+static constexpr size_t maxSize() {
+	size_t res = 0;
+	for (const auto &o : Objects) {
+		res = std::max(res, o.Size);
+	}
+	for (const auto &o : Together) {
+		res = std::max(res, o.Size);
+	}
+	return res;
+}
+
+static constexpr size_t MaxSize = maxSize();
+
+static void fill(uint8_t *data, size_t size, int value) {
+	memcpy(data, &value, sizeof(int));
+	for (size_t i = sizeof(int); i < size; ++i) {
+		data[i] = uint8_t(value * 31 + i);
+	}
+}
+
+// value held by a loaded object, or -1 when it is corrupted.
+static int valueOf(const uint8_t *data, size_t size) {
+	int     value;
+	uint8_t expected[MaxSize];
+	memcpy(&value, data, sizeof(int));
+	fill(expected, size, value);
+	return memcmp(data, expected, size) == 0 ? value : -1;
+}
+
+struct Outcome {
+	// last value each object was saved with, or -1.
+	int Committed[NbObjects];
+	int InFlight[NbObjects];
+	// of the transactions.
+	int TxCommitted;
+	int TxInFlight;
+};
+
+static details::NVStorage::Progress
+saveTogether(details::NVStorage &storage, int value) {
+	uint8_t                   data[NbTogether][FLASH_PAGE_SIZE];
+	details::NVStorage::Entry entries[NbTogether];
+	for (size_t i = 0; i < NbTogether; ++i) {
+		fill(data[i], Together[i].Size, value);
+		entries[i] = {
+		    .UUID   = Together[i].UUID,
+		    .Object = data[i],
+		    .Size   = Together[i].Size,
+		};
+	}
+	return storage.SaveAll(entries, NbTogether);
+}
+
+// runs the saves until the power is cut.
+static Outcome run(SimulatedFlash &flash) {
+	details::NVStorage storage(flash);
+	Outcome            res;
+	uint8_t            data[MaxSize];
+	for (size_t i = 0; i < NbObjects; ++i) {
+		res.Committed[i] = res.InFlight[i] = -1;
+	}
+	res.TxCommitted = res.TxInFlight = -1;
+	for (int value = 0; value < NbSaves; ++value) {
+		if (value % 3 == 2) {
+			res.TxInFlight = value;
+			saveTogether(storage, value);
+			if (flash.PoweredOff()) {
+				break;
+			}
+			res.TxCommitted = value;
+		}
+		size_t i        = value % NbObjects;
+		res.InFlight[i] = value;
+		fill(data, Objects[i].Size, value);
+		storage.Save(Objects[i].UUID, data, Objects[i].Size);
+		if (flash.PoweredOff()) {
+			break;
+		}
+		res.Committed[i] = value;
+	}
+	return res;
+}
+
+static bool check(SimulatedFlash &flash, const Outcome &outcome) {
+	details::NVStorage storage(flash);
+	uint8_t            data[MaxSize];
+	bool               ok = true;
+	for (size_t i = 0; i < NbObjects; ++i) {
+		const auto &o      = Objects[i];
+		bool        loaded = storage.Load(o.UUID, data, o.Size);
+		int         value  = loaded ? valueOf(data, o.Size) : -1;
+		if (loaded == false && outcome.Committed[i] < 0) {
+			continue;
+		}
+		if (value < 0 ||
+		    (value != outcome.Committed[i] && value != outcome.InFlight[i])) {
+			printf(
+			    "  UUID=%d: got %d, expected %d or %d\n",
+			    o.UUID,
+			    value,
+			    outcome.Committed[i],
+			    outcome.InFlight[i]
+			);
+			ok = false;
+		}
+	}
+
+	int together[NbTogether];
+	for (size_t i = 0; i < NbTogether; ++i) {
+		const auto &o = Together[i];
+		together[i]   = storage.Load(o.UUID, data, o.Size)
+		                    ? valueOf(data, o.Size)
+		                    : -1;
+	}
+	if (together[0] != together[1] ||
+	    (together[0] != outcome.TxCommitted &&
+	     together[0] != outcome.TxInFlight)) {
+		printf(
+		    "  transaction: got %d and %d, expected %d or %d\n",
+		    together[0],
+		    together[1],
+		    outcome.TxCommitted,
+		    outcome.TxInFlight
+		);
+		ok = false;
+	}
+
+	// the recovered storage keeps accepting new values, enough of them to
+	// compact every sector, and they survive a remount.
+	int last = 1000 + storage.Sectors() * NbSaves;
+	for (int value = 1000; value < last; ++value) {
+		const auto &o = Objects[value % NbObjects];
+		fill(data, o.Size, value);
+		storage.Save(o.UUID, data, o.Size);
+		if (value % 3 == 2) {
+			saveTogether(storage, value);
+		}
+	}
+	details::NVStorage remounted(flash);
+	for (size_t i = 0; i < NbObjects; ++i) {
+		const auto &o        = Objects[i];
+		int         expected = last - 1;
+		while (expected % NbObjects != i) {
+			--expected;
+		}
+		if (remounted.Load(o.UUID, data, o.Size) == false ||
+		    valueOf(data, o.Size) != expected) {
+			printf("  UUID=%d: lost after recovery\n", o.UUID);
+			ok = false;
+		}
+	}
+	for (const auto &o : Together) {
+		int expected = last - 1;
+		while (expected % 3 != 2) {
+			--expected;
+		}
+		if (remounted.Load(o.UUID, data, o.Size) == false ||
+		    valueOf(data, o.Size) != expected) {
+			printf("  UUID=%d: transaction lost after recovery\n", o.UUID);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+static void powerFail(size_t nbSectors, unsigned seeds) {
+	size_t operations;
+	{
+		SimulatedFlash flash(nbSectors);
+		run(flash);
+		operations = flash.Operations();
+	}
+
+	size_t failures = 0;
+	for (size_t cut = 0; cut < operations; ++cut) {
+		for (unsigned seed = 0; seed < seeds; ++seed) {
+			srand(cut * seeds + seed);
+			SimulatedFlash flash(nbSectors);
+			flash.CutPowerAt(cut);
+			auto outcome = run(flash);
+			flash.PowerOn();
+			if (check(flash, outcome) == false) {
+				printf("  power cut at operation %d, seed %d\n", cut, seed);
+				++failures;
+			}
+		}
+	}
+	printf(
+	    "sectors:%2d | %4d operations x %d torn writes | failures: %d\n",
+	    nbSectors,
+	    operations,
+	    seeds,
+	    failures
+	);
+}
+
+int main() {
+	stdio_init_all();
+	sleep_ms(2000);
+
+	printf("NVStorage power loss harness\n");
+	for (size_t nbSectors : {2, 3, 5}) {
+		powerFail(nbSectors, 4);
+	}
+
+	while (true) {
+		tight_loop_contents();
+	}
+}
@@ -0,0 +1,139 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+// Runs typical mixes of saves and loads through NVStorage on a simulated
+// flash, and reports for each of them:
+//  - saves per sector erase, the wear of the flash,
+//  - bytes read through the device per load, which go through XIP on boards,
+//  - write amplification: bytes programmed per byte of object saved,
+//  - the time the flash is busy per save, during which the other core is
+//    locked out, from PICO_NV_STORAGE_PAGE_PROGRAM_US and
+//    PICO_NV_STORAGE_SECTOR_ERASE_US.
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+#include <pico/stdlib.h>
+
+#include <utils/FlashDevice.hpp>
+#include <utils/FlashStorage.hpp>
+
+struct Object {
+	uint16_t UUID;
+	size_t   Size;
+	// saved every that many steps.
+	int Every;
+};
+
+struct Workload {
+	const char   *Name;
+	const Object *Objects;
+	size_t        NbObjects;
+};
+
+// a few settings changed by a user, and a calibration once in a while.
+static constexpr Object Settings[] = {
+    {.UUID = 1, .Size = 64, .Every = 1},
+    {.UUID = 2, .Size = 64, .Every = 3},
+    {.UUID = 3, .Size = 32, .Every = 5},
+    {.UUID = 4, .Size = 600, .Every = 50},
+};
+
+// counters and a state machine saved at every step.
+static constexpr Object Counters[] = {
+    {.UUID = 1, .Size = 4, .Every = 1},
+    {.UUID = 2, .Size = 4, .Every = 1},
+    {.UUID = 3, .Size = 16, .Every = 2},
+};
+
+// objects of all sizes, some spanning several pages.
+static constexpr Object Mixed[] = {
+    {.UUID = 1, .Size = 4, .Every = 1},
+    {.UUID = 2, .Size = 40, .Every = 2},
+    {.UUID = 3, .Size = 300, .Every = 3},
+    {.UUID = 4, .Size = 1000, .Every = 7},
+};
+
+// a large history appended to, mostly left unchanged.
+static constexpr Object History[] = {
+    {.UUID = 1, .Size = 2000, .Every = 4},
+    {.UUID = 2, .Size = 8, .Every = 1},
+};
+
+#define WORKLOAD(name, objects)                                                \
+	{.Name = name, .Objects = objects, .NbObjects = std::size(objects)}
+
+static constexpr Workload Workloads[] = {
+    WORKLOAD("settings", Settings),
+    WORKLOAD("counters", Counters),
+    WORKLOAD("mixed", Mixed),
+    WORKLOAD("history", History),
+};
+
+static void run(const Workload &w, size_t nbSectors) {
+	constexpr static int Steps = 1000;
+
+	SimulatedFlash     flash(nbSectors);
+	details::NVStorage storage(flash);
+	storage.Mount();
+	flash.ResetCounters();
+
+	static uint8_t data[FLASH_SECTOR_SIZE];
+	size_t         saves = 0, saved = 0, loads = 0, read = 0;
+	uint64_t       maxBusy_us = 0;
+	for (int step = 0; step < Steps; ++step) {
+		for (size_t i = 0; i < w.NbObjects; ++i) {
+			const auto &o = w.Objects[i];
+			if (step % o.Every != 0) {
+				continue;
+			}
+			// each save changes a few bytes of the object.
+			memcpy(data + (step * 4) % (o.Size - 3), &step, 4);
+			auto before = flash.Busy_us();
+			storage.Save(o.UUID, data, o.Size);
+			maxBusy_us = std::max(maxBusy_us, flash.Busy_us() - before);
+			++saves;
+			saved += o.Size;
+		}
+
+		const auto &o      = w.Objects[step % w.NbObjects];
+		auto        before = flash.BytesRead();
+		storage.Load(o.UUID, data, o.Size);
+		read += flash.BytesRead() - before;
+		++loads;
+	}
+
+	uint32_t erases = 0;
+	for (size_t i = 0; i < nbSectors; ++i) {
+		erases += flash.EraseCount(i);
+	}
+	printf(
+	    "%-9s sectors:%2d | saves per erase: %4lu | read per load: %4dB | "
+	    "write amplification: %2d.%02d | busy per save: %5lluus mean, "
+	    "%6lluus max\n",
+	    w.Name,
+	    nbSectors,
+	    saves / std::max<uint32_t>(erases, 1),
+	    read / loads,
+	    flash.BytesProgrammed() / saved,
+	    flash.BytesProgrammed() * 100 / saved % 100,
+	    flash.Busy_us() / saves,
+	    maxBusy_us
+	);
+}
+
+int main() {
+	stdio_init_all();
+	sleep_ms(2000);
+
+	printf("NVStorage workloads over 1000 steps\n");
+	for (const auto &w : Workloads) {
+		for (size_t nbSectors : {2, 4, 8}) {
+			run(w, nbSectors);
+		}
+	}
+
+	while (true) {
+		tight_loop_contents();
+	}
+}
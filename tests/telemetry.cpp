@@ -0,0 +1,61 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+// Pushes bursts of records from core 0 while core 1 sends them. Decode the
+// output with:
+//   tools/telemetry.py /dev/ttyACM0 --quiet --record 1:Sample:<IfffI
+#include <pico/stdio.h>
+#include <pico/time.h>
+
+#include <utils/Log.hpp>
+#include <utils/Scheduler.hpp>
+#include <utils/Telemetry.hpp>
+
+struct Sample {
+	uint32_t Index;
+	float    Position, Speed, Command;
+	uint32_t Flags;
+};
+
+TELEMETRY_RECORD(Sample, 1);
+
+int main() {
+	stdio_init_all();
+
+	Scheduler::InitWorkLoopOnCore1(Telemetry::ScheduleSending);
+	Logger::ScheduleLogFormatting();
+
+	Scheduler::Get().Schedule(
+	    1000 * 1000,
+	    []() {
+		    constexpr static uint32_t Burst = 100;
+
+		    static uint32_t index = 0;
+		    auto            start = get_absolute_time();
+		    for (uint32_t i = 0; i < Burst; ++i, ++index) {
+			    Telemetry::Push(Sample{
+			        .Index    = index,
+			        .Position = 0.5f * index,
+			        .Speed    = 0.5f,
+			        .Command  = 1.0f,
+			        .Flags    = 0,
+			    });
+		    }
+		    auto elapsed = absolute_time_diff_us(start, get_absolute_time());
+		    auto stats   = Telemetry::GetStats();
+
+		    Infof(
+		        "pushed %lu records in %lldus (%llu records/s), total "
+		        "pushed:%lu dropped:%lu sent:%lu",
+		        Burst,
+		        elapsed,
+		        Burst * 1000000ULL / std::max(elapsed, int64_t(1)),
+		        stats.Pushed,
+		        stats.Dropped,
+		        stats.Sent
+		    );
+	    },
+	    {.Name = "telemetry/bench"}
+	);
+
+	Scheduler::WorkLoop();
+}
@@ -0,0 +1,82 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <pico/stdio.h>
+#include <pico/time.h>
+
+#include <utils/Log.hpp>
+#include <utils/Scheduler.hpp>
+#include <utils/UARTOutput.hpp>
+
+// Drives a TxStream with a software stand-in for the DMA and the UART,
+// checking that bytes come out in order across many wrap arounds.
+static bool checkTxStream() {
+	details::TxStream<64> stream;
+	std::vector<uint8_t>  sent, received;
+	uint8_t               next = 0;
+
+	srand(42);
+	for (int i = 0; i < 10000; ++i) {
+		uint8_t chunk[40];
+		size_t  size = rand() % sizeof(chunk);
+		for (size_t j = 0; j < size; ++j) {
+			chunk[j] = next + j;
+		}
+		auto accepted = stream.write(chunk, size);
+		sent.insert(sent.end(), chunk, chunk + accepted);
+		next += accepted;
+
+		// the stand-in completes its transfers at random times
+		if (rand() % 3 == 0) {
+			continue;
+		}
+		if (stream.busy()) {
+			stream.complete();
+		}
+		auto [data, count] = stream.next();
+		received.insert(received.end(), data, data + count);
+	}
+	while (stream.busy() || stream.size() > 0) {
+		stream.complete();
+		auto [data, count] = stream.next();
+		received.insert(received.end(), data, data + count);
+	}
+
+	printf(
+	    "TxStream stand-in: sent:%d received:%d dropped:%d high water:%d -> "
+	    "%s\n",
+	    sent.size(),
+	    received.size(),
+	    stream.dropped(),
+	    stream.highWaterMark(),
+	    sent == received ? "OK" : "FAILED"
+	);
+	return sent == received;
+}
+
+int main() {
+	UARTOutput::Init(uart0, 0);
+
+	checkTxStream();
+
+	Logger::ScheduleLogFormatting();
+
+	Scheduler::Get().Schedule(1000 * 1000, []() {
+		auto start = get_absolute_time();
+		Infof("a log line long enough to take several ms at 115200 bauds");
+		Logger::FormatsNextPendingLog();
+		auto elapsed = absolute_time_diff_us(start, get_absolute_time());
+		printf(
+		    "log formatted in %lldus, pending:%d high water:%d dropped:%d\n",
+		    elapsed,
+		    UARTOutput::Pending(),
+		    UARTOutput::HighWaterMark(),
+		    UARTOutput::Dropped()
+		);
+	});
+
+	Scheduler::WorkLoop();
+}
@@ -0,0 +1,113 @@
+// SPDX-License_identifier:  LGPL-3.0-or-later
+
+// Checks the frames encoded for WS2812 strips against golden bitstreams, as
+// shifted out by the PIO. The encoder does not touch the hardware, so this
+// runs on any board. Boards defining PICO_DEFAULT_WS2812_PIN then show a
+// rainbow breathing on their strip.
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+#include <pico/stdlib.h>
+
+#include <utils/WS2812.hpp>
+
+#include "Checks.hpp"
+
+#ifdef PICO_DEFAULT_WS2812_PIN
+#include <utils/LEDStrip.hpp>
+#include <utils/Scheduler.hpp>
+#endif
+
+struct Golden {
+	uint16_t    Brightness;
+	RGB         Pixel;
+	const char *Bits;
+};
+
+// computed with the CIE 1931 formula outside of this code base.
+static const Golden GOLDENS[] = {
+    {0xff00, {255, 0, 0}, "00000000 11111111 00000000"},
+    {0xff00, {0, 255, 0}, "11111111 00000000 00000000"},
+    {0xff00, {0, 0, 255}, "00000000 00000000 11111111"},
+    {0xff00, {128, 64, 1}, "00001011 00101111 00000000"},
+    {0xff00, {255, 255, 255}, "11111111 11111111 11111111"},
+    {0x8000, {255, 255, 255}, "00101111 00101111 00101111"},
+    {0x8000, {128, 64, 1}, "00000100 00001011 00000000"},
+    {0x0000, {255, 255, 255}, "00000000 00000000 00000000"},
+};
+
+// the 24 bits of a pixel in the order they are sent.
+static void bitstream(uint32_t word, char *out) {
+	for (int i = 0; i < 24; ++i) {
+		if (i > 0 && i % 8 == 0) {
+			*out++ = ' ';
+		}
+		*out++ = (word >> (31 - i)) & 1 ? '1' : '0';
+	}
+	*out = 0;
+}
+
+static void goldens() {
+	details::WS2812Encoder encoder;
+	for (const auto &g : GOLDENS) {
+		uint32_t word;
+		char     bits[27];
+		encoder.SetBrightness(g.Brightness);
+		encoder.Encode(&g.Pixel, 1, &word);
+		bitstream(word, bits);
+		Checkf(
+		    strcmp(bits, g.Bits) == 0,
+		    "brightness 0x%04x {%3d,%3d,%3d} -> %s",
+		    g.Brightness,
+		    g.Pixel.R,
+		    g.Pixel.G,
+		    g.Pixel.B,
+		    bits
+		);
+	}
+
+	// the same pixels in a single frame.
+	RGB      frame[std::size(GOLDENS)];
+	uint32_t words[std::size(GOLDENS)];
+	for (size_t i = 0; i < std::size(GOLDENS); ++i) {
+		frame[i] = GOLDENS[i].Pixel;
+	}
+	encoder.SetBrightness(0xff00);
+	encoder.Encode(frame, std::size(frame), words);
+	bool ok = true;
+	for (size_t i = 0; i < std::size(GOLDENS); ++i) {
+		char bits[27];
+		bitstream(words[i], bits);
+		ok = ok && (GOLDENS[i].Brightness != 0xff00 ||
+		            strcmp(bits, GOLDENS[i].Bits) == 0);
+		ok = ok && (words[i] & 0xff) == 0;
+	}
+	Checkf(ok, "whole frame");
+}
+
+int main() {
+	stdio_init_all();
+	sleep_ms(2000);
+
+	printf("WS2812 encoding\n");
+	goldens();
+	int failures = ReportChecks();
+
+#ifdef PICO_DEFAULT_WS2812_PIN
+	static LEDStrip strip(PICO_DEFAULT_WS2812_PIN, 8);
+	for (size_t i = 0; i < strip.Size(); ++i) {
+		uint8_t phase     = i * 255 / strip.Size();
+		strip.Pixels()[i] = {
+		    .R = phase,
+		    .G = uint8_t(255 - phase),
+		    .B = uint8_t(phase / 2),
+		};
+	}
+	strip.Show();
+	strip.Play(LEDPatterns::HEARTBEAT);
+	LEDStrip::ScheduleUpdateTask();
+	Scheduler::WorkLoop();
+#endif
+	return failures;
+}
@@ -0,0 +1,332 @@
+#!/usr/bin/env python3
+# SPDX-License_identifier:  LGPL-3.0-or-later
+"""Creates and inspects images of the NVStorage region (utils/FlashStorage.hpp).
+
+The image covers the PICO_NV_STORAGE_NB_SECTOR last sectors of the flash, to
+be programmed at the end of it, e.g. for a 2MB flash and 2 sectors:
+
+    tools/nvstorage.py create nv.bin --sectors 2 \\
+        --blob wifi/ssid=workshop --blob cal/0=@cal0.bin --object 0x100=@s.bin
+    picotool load -o 0x101fe000 nv.bin
+
+Inspecting an image read back from a board lists its sectors and the current
+objects, FlashStorage ones by UUID and BlobStorage ones by key:
+
+    picotool save -r 0x101fe000 0x10200000 nv.bin
+    tools/nvstorage.py inspect nv.bin
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+SECTOR_SIZE = 4096
+PAGE_SIZE = 256
+SLOT_SIZE = 16
+SLOTS_PER_SECTOR = SECTOR_SIZE // SLOT_SIZE
+FIRST_SLOT = 2
+
+SECTOR_MAGIC = 0x4E565334
+MAGIC_WORD = 0xAA
+UNUSED = 0xFFFFFFFF
+
+SECTOR_HEADER = struct.Struct("<IIIII")
+HEADER = struct.Struct("<BBHIHHI")
+# the CRC covers the header up to Flags, then the object.
+CRC_COVERED = 10
+
+STANDALONE = 0xFFFF
+IN_TRANSACTION = 0xFFFE
+
+FIRST_RESERVED_UUID = 0xC000
+DELETE_UUID = 0xFFFE
+COMMIT_UUID = 0xFFFF
+MAX_KEY_SIZE = 31
+
+
+def crc32(data, crc=0):
+    return zlib.crc32(data, crc) & 0xFFFFFFFF
+
+
+def slots_for(size):
+    return (HEADER.size + size + SLOT_SIZE - 1) // SLOT_SIZE
+
+
+class Record:
+    def __init__(self, slot, identifier, sequence, flags, data):
+        self.slot = slot
+        self.identifier = identifier
+        self.sequence = sequence
+        self.flags = flags
+        self.data = data
+
+
+def parse_sector(image, sector):
+    """Yields the valid records of a sector, in order."""
+    base = sector * SECTOR_SIZE
+    slot = FIRST_SLOT
+    while slot < SLOTS_PER_SECTOR:
+        offset = base + slot * SLOT_SIZE
+        begin, size_in_slots, identifier, sequence, size, flags, crc = (
+            HEADER.unpack_from(image, offset)
+        )
+        if (
+            begin == MAGIC_WORD
+            and size_in_slots > 0
+            and slot + size_in_slots <= SLOTS_PER_SECTOR
+        ):
+            header = image[offset : offset + CRC_COVERED]
+            data = image[offset + HEADER.size : offset + HEADER.size + size]
+            if (
+                size <= size_in_slots * SLOT_SIZE - HEADER.size
+                and crc32(data, crc32(header)) == crc
+            ):
+                yield Record(
+                    sector * SLOTS_PER_SECTOR + slot,
+                    identifier,
+                    sequence,
+                    flags,
+                    data,
+                )
+            slot += size_in_slots
+            continue
+        # the rest of the page, as a torn program may leave its first bytes
+        # erased.
+        end = offset - offset % PAGE_SIZE + PAGE_SIZE
+        if all(b == 0xFF for b in image[offset:end]):
+            break
+        slot += 1
+
+
+class Storage:
+    """Current objects of an image, following the rules of the mount."""
+
+    def __init__(self, image):
+        if len(image) % SECTOR_SIZE != 0 or len(image) < 2 * SECTOR_SIZE:
+            raise ValueError("the image must hold at least 2 whole sectors")
+        self.sectors = []
+        self.objects = {}
+        log = []
+        for i in range(len(image) // SECTOR_SIZE):
+            magic, erase_count, erase_check, sequence, sequence_check = (
+                SECTOR_HEADER.unpack_from(image, i * SECTOR_SIZE)
+            )
+            state = "blank"
+            if magic == SECTOR_MAGIC and erase_check == ~erase_count & UNUSED:
+                state = "spare"
+                if sequence_check == ~sequence & UNUSED:
+                    state = f"log #{sequence}"
+                    log.append((sequence, i))
+            else:
+                erase_count = None
+            self.sectors.append((state, erase_count))
+
+        for _, sector in sorted(log):
+            members = []
+            for r in parse_sector(image, sector):
+                if r.identifier == COMMIT_UUID:
+                    (first,) = struct.unpack("<I", r.data[:4].ljust(4, b"\xff"))
+                    for m in members:
+                        if first <= m.sequence < r.sequence:
+                            self.index(m.identifier, m)
+                    members = []
+                elif r.identifier == DELETE_UUID:
+                    (uuid,) = struct.unpack("<H", r.data[:2])
+                    self.index(uuid, Record(None, uuid, r.sequence, 0, None))
+                elif r.flags == IN_TRANSACTION:
+                    members.append(r)
+                else:
+                    self.index(r.identifier, r)
+        self.objects = {
+            uuid: r for uuid, r in self.objects.items() if r.data is not None
+        }
+
+    def index(self, uuid, record):
+        current = self.objects.get(uuid)
+        if current is None or record.sequence >= current.sequence:
+            self.objects[uuid] = record
+
+    def blobs(self):
+        """BlobStorage keys and values."""
+        res = {}
+        for uuid, r in self.objects.items():
+            if FIRST_RESERVED_UUID <= uuid < DELETE_UUID and uuid % 2 == 0:
+                value = self.objects.get(uuid + 1)
+                if value is not None:
+                    res[r.data.decode(errors="replace")] = value.data
+        return res
+
+
+class Writer:
+    """Lays out records in a blank image, the way NVStorage would."""
+
+    def __init__(self, nb_sectors):
+        self.image = bytearray(b"\xff" * nb_sectors * SECTOR_SIZE)
+        self.nb_sectors = nb_sectors
+        self.sector = -1
+        self.slot = SLOTS_PER_SECTOR
+        self.sequence = 0
+        self.blob_uuids = set()
+        for i in range(nb_sectors):
+            self.format(i, UNUSED)
+
+    def format(self, sector, sequence):
+        check = UNUSED if sequence == UNUSED else ~sequence & UNUSED
+        SECTOR_HEADER.pack_into(
+            self.image,
+            sector * SECTOR_SIZE,
+            SECTOR_MAGIC,
+            0,
+            UNUSED,
+            sequence,
+            check,
+        )
+
+    def records(self, records):
+        """Programs consecutive records, in a single sector."""
+        slots = sum(slots_for(len(data)) for _, data, _ in records)
+        if slots > SLOTS_PER_SECTOR - FIRST_SLOT:
+            raise ValueError("records do not fit in a sector")
+        if self.slot + slots > SLOTS_PER_SECTOR:
+            # one sector stays erased for the compactions.
+            if self.sector + 2 >= self.nb_sectors:
+                raise ValueError("the image is full")
+            self.sector += 1
+            self.format(self.sector, self.sector + 1)
+            self.slot = FIRST_SLOT
+        for identifier, data, flags in records:
+            self.sequence += 1
+            header = HEADER.pack(
+                MAGIC_WORD,
+                slots_for(len(data)),
+                identifier,
+                self.sequence,
+                len(data),
+                flags,
+                0,
+            )
+            crc = crc32(data, crc32(header[:CRC_COVERED]))
+            header = header[:-4] + struct.pack("<I", crc)
+            offset = self.sector * SECTOR_SIZE + self.slot * SLOT_SIZE
+            self.image[offset : offset + len(header) + len(data)] = header + data
+            self.slot += slots_for(len(data))
+
+    def object(self, uuid, data):
+        if uuid >= FIRST_RESERVED_UUID:
+            raise ValueError(f"UUID 0x{uuid:04x} is reserved")
+        self.records([(uuid, data, STANDALONE)])
+
+    def blob(self, key, data):
+        key = key.encode()
+        if len(key) > MAX_KEY_SIZE:
+            raise ValueError(f"key {key} is too long")
+        # the same identifier BlobStorage would pick first for the key.
+        nb_keys = (DELETE_UUID - FIRST_RESERVED_UUID) // 2
+        h = 2166136261
+        for b in key:
+            h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+        i = h % nb_keys
+        while FIRST_RESERVED_UUID + 2 * i in self.blob_uuids:
+            i = (i + 1) % nb_keys
+        uuid = FIRST_RESERVED_UUID + 2 * i
+        self.blob_uuids.add(uuid)
+        first = self.sequence + 1
+        self.records(
+            [
+                (uuid, key, IN_TRANSACTION),
+                (uuid + 1, data, IN_TRANSACTION),
+                (COMMIT_UUID, struct.pack("<I", first), STANDALONE),
+            ]
+        )
+
+
+def parse_value(text):
+    if text.startswith("@"):
+        with open(text[1:], "rb") as f:
+            return f.read()
+    if text.startswith("0x"):
+        return bytes.fromhex(text[2:])
+    return text.encode()
+
+
+def parse_pair(arg):
+    name, value = arg.split("=", 1)
+    return name, parse_value(value)
+
+
+def printable(data):
+    if all(32 <= b < 127 for b in data):
+        return repr(data.decode())
+    return data.hex()
+
+
+def inspect(args):
+    with open(args.image, "rb") as f:
+        storage = Storage(f.read())
+    for i, (state, erase_count) in enumerate(storage.sectors):
+        erases = "-" if erase_count is None else erase_count
+        print(f"sector {i}: {state:<10} erased {erases} time(s)")
+    for uuid, r in sorted(storage.objects.items()):
+        if uuid < FIRST_RESERVED_UUID:
+            print(f"object 0x{uuid:04x}: {len(r.data):4d}B {printable(r.data)}")
+    for key, data in sorted(storage.blobs().items()):
+        print(f"blob {key!r}: {len(data):4d}B {printable(data)}")
+    return 0
+
+
+def create(args):
+    writer = Writer(args.sectors)
+    for uuid, data in args.object:
+        writer.object(int(uuid, 0), data)
+    for key, data in args.blob:
+        writer.blob(key, data)
+    with open(args.image, "wb") as f:
+        f.write(writer.image)
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    parser_inspect = commands.add_parser("inspect", help="list the objects")
+    parser_inspect.add_argument("image")
+    parser_inspect.set_defaults(run=inspect)
+
+    parser_create = commands.add_parser("create", help="write a new image")
+    parser_create.add_argument("image")
+    parser_create.add_argument(
+        "--sectors",
+        type=int,
+        default=2,
+        help="PICO_NV_STORAGE_NB_SECTOR of the firmware",
+    )
+    parser_create.add_argument(
+        "--object",
+        action="append",
+        default=[],
+        type=parse_pair,
+        metavar="UUID=VALUE",
+        help="FlashStorage object, VALUE is text, 0x<hex> or @<file>",
+    )
+    parser_create.add_argument(
+        "--blob",
+        action="append",
+        default=[],
+        type=parse_pair,
+        metavar="KEY=VALUE",
+        help="BlobStorage value, VALUE is text, 0x<hex> or @<file>",
+    )
+    parser_create.set_defaults(run=create)
+
+    args = parser.parse_args()
+    try:
+        return args.run(args)
+    except ValueError as e:
+        print(f"error: {e}", file=sys.stderr)
+        return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+# SPDX-License_identifier:  LGPL-3.0-or-later
+"""Decodes and validates the packets sent by Telemetry (utils/Telemetry.hpp).
+
+Reads a byte stream (a serial device or a capture file), splits it on 0x00
+delimiters, COBS decodes each packet, checks its CRC-16 and sequence number,
+then prints the records. Record layouts are given as struct format strings:
+
+    tools/telemetry.py /dev/ttyACM0 --record 1:Attitude:<fff
+
+Packets start and end with a 0x00, so text logs sharing the same output fall
+between two packets. Such bytes are counted as garbage and skipped, apart
+from the packets that fail their CRC, which are counted as invalid.
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+HEADER = struct.Struct("<HBBI")
+MAX_RECORD_SIZE = 240
+
+
+def crc16(data, crc=0xFFFF):
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            raise ValueError("invalid COBS block")
+        out += data[i + 1 : i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+class Decoder:
+    def __init__(self, layouts):
+        self.layouts = layouts
+        self.buffer = bytearray()
+        self.sequences = {}
+        self.packets = 0
+        self.lost = 0
+        self.invalid = 0
+        self.garbage = 0
+
+    def feed(self, data):
+        self.buffer += data
+        while True:
+            end = self.buffer.find(b"\x00")
+            if end < 0:
+                return
+            frame = bytes(self.buffer[:end])
+            del self.buffer[: end + 1]
+            if frame:
+                yield from self.packet(frame)
+
+    def packet(self, frame):
+        # bytes between delimiters that can not be a packet, such as text,
+        # are garbage. A packet failing its CRC is invalid.
+        try:
+            data = cobs_decode(frame)
+        except ValueError:
+            self.garbage += len(frame)
+            return
+        if not 0 <= len(data) - HEADER.size - 2 <= MAX_RECORD_SIZE:
+            self.garbage += len(frame)
+            return
+        payload, crc = data[:-2], int.from_bytes(data[-2:], "little")
+        if crc16(payload) != crc:
+            if HEADER.unpack_from(payload)[2] > 1:
+                self.garbage += len(frame)
+            else:
+                self.invalid += 1
+            return
+        sequence, identifier, core, time_us = HEADER.unpack_from(payload)
+        record = payload[HEADER.size :]
+
+        expected = self.sequences.get(core)
+        if expected is not None and sequence != expected:
+            self.lost += (sequence - expected) & 0xFFFF
+        self.sequences[core] = (sequence + 1) & 0xFFFF
+        self.packets += 1
+
+        name, layout = self.layouts.get(identifier, (f"#{identifier}", None))
+        if layout is not None and layout.size == len(record):
+            values = layout.unpack(record)
+        else:
+            values = record.hex()
+        yield core, sequence, time_us, name, values
+
+
+def parse_layout(arg):
+    identifier, name, fmt = arg.split(":", 2)
+    return int(identifier, 0), (name, struct.Struct(fmt))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", help="serial device or capture file")
+    parser.add_argument(
+        "--record",
+        action="append",
+        default=[],
+        type=parse_layout,
+        metavar="ID:NAME:FORMAT",
+        help="python struct format of a record type",
+    )
+    parser.add_argument(
+        "--quiet", action="store_true", help="only print statistics"
+    )
+    args = parser.parse_args()
+
+    decoder = Decoder(dict(args.record))
+    start = time.monotonic()
+    with open(args.input, "rb", buffering=0) as stream:
+        try:
+            while True:
+                chunk = stream.read(4096)
+                if not chunk:
+                    break
+                for core, sequence, time_us, name, values in decoder.feed(chunk):
+                    if not args.quiet:
+                        print(f"[{core}:{sequence:5d}] {time_us:10d}us {name} {values}")
+        except KeyboardInterrupt:
+            pass
+
+    elapsed = max(time.monotonic() - start, 1e-6)
+    print(
+        f"packets: {decoder.packets} ({decoder.packets / elapsed:.0f}/s) "
+        f"lost: {decoder.lost} invalid: {decoder.invalid} "
+        f"garbage: {decoder.garbage} bytes",
+        file=sys.stderr,
+    )
+    return 1 if decoder.invalid or decoder.lost else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())